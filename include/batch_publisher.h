@@ -0,0 +1,140 @@
+#ifndef BATCH_PUBLISHER_H
+#define BATCH_PUBLISHER_H
+
+// Batching for MQTT publishes
+//
+// Sending every 2-second sample as its own ~60-byte message means the MQTT
+// and TCP/IP headers cost about as much as the data itself, and the broker
+// sees one message per sample per device. SampleBatcher collects samples and
+// hands them out as one message once it has N of them or the oldest one is
+// T milliseconds old, whichever comes first.
+//
+// The payload has a shared header and one array per field, with the
+// timestamps delta-encoded (t0 is the first sample's millis(), "dt" holds the
+// gap to the previous sample, and "now" is millis() when the message was built,
+// so the receiver can work out each sample's age even for late batches):
+//
+//   {"bus":0,"addr":118,"n":3,"now":124100,"t0":120000,"dt":[0,2000,2000],
+//    "temperature":[23.45,23.47,23.46],"humidity":[...],"pressure":[...]}
+//
+// It also keeps size and latency statistics so N and T can be tuned.
+
+#include <stdint.h>
+#include "sample_buffer.h"
+#include "fixed_format.h"
+
+#define BATCH_MAX_SAMPLES        16     // Upper limit for N (fits PAYLOAD_MAX_BYTES in any format)
+#define BATCH_DEFAULT_SAMPLES    10     // N: flush after this many samples
+#define BATCH_DEFAULT_AGE_MS     30000  // T: ...or when the oldest sample is this old
+
+// Rough bytes per message besides the payload: MQTT fixed header (2), topic
+// length (2) and TCP/IP headers (40). Only used for the statistics
+#define BATCH_MESSAGE_OVERHEAD   44
+
+typedef struct {
+    uint32_t batches;        // Messages built
+    uint32_t samples;        // Samples in them
+    uint32_t payloadBytes;   // Total payload size
+    uint32_t wireBytes;      // Payload plus estimated per-message overhead
+    uint64_t latencySumMs;   // Sum over all samples of (flush time - sample time)
+                             // (64 bits: 32 would wrap after ~49.7 days of it)
+    uint32_t maxLatencyMs;   // Longest any sample waited
+    uint32_t dropped;        // Samples thrown away unsent (see drop())
+} BatchStats;
+
+class SampleBatcher {
+private:
+    BufferedSample samples[BATCH_MAX_SAMPLES];
+    uint8_t count;
+    uint8_t maxSamples;
+    uint32_t maxAgeMs;
+
+public:
+    BatchStats stats;
+
+    SampleBatcher(uint8_t n = BATCH_DEFAULT_SAMPLES, uint32_t ageMs = BATCH_DEFAULT_AGE_MS) : count(0) {
+        setPolicy(n, ageMs);
+        resetStats();
+    }
+
+    // N samples or T milliseconds, whichever comes first (N = 1 is no batching)
+    void setPolicy(uint8_t n, uint32_t ageMs) {
+        maxSamples = (n < 1) ? 1 : (n > BATCH_MAX_SAMPLES) ? BATCH_MAX_SAMPLES : n;
+        maxAgeMs = ageMs;
+    }
+    uint8_t getMaxSamples() const { return maxSamples; }
+    uint32_t getMaxAgeMs() const { return maxAgeMs; }
+
+    void resetStats() { stats = BatchStats{0, 0, 0, 0, 0, 0, 0}; }
+
+    // Add a sample; returns true when the batch is full and should be sent now
+    bool add(const BufferedSample &sample) {
+        if (count < BATCH_MAX_SAMPLES) {
+            samples[count++] = sample;
+        }
+        return count >= maxSamples;
+    }
+
+    // True when there's something waiting and the oldest sample is T old
+    bool due(uint32_t nowMs) const {
+        return count > 0 && (nowMs - samples[0].timestamp) >= maxAgeMs;
+    }
+
+    uint8_t size() const { return count; }
+    const BufferedSample &sample(uint8_t index) const { return samples[index]; }
+    void clear() { count = 0; }
+
+    // Give up on the batch, counting the samples so the loss shows up in
+    // the statistics
+    void drop() {
+        stats.dropped += count;
+        count = 0;
+    }
+
+    // Write the batch as JSON into 'out'; the header carries the sensor's bus
+    // and address. The batch is kept until sent() or clear(), so a failed
+    // publish can retry or move the samples somewhere else
+    void build(TextBuffer &out, uint8_t bus, uint8_t address, uint32_t nowMs) const {
+        out.add("{\"bus\":").addUInt(bus)
+           .add(",\"addr\":").addUInt(address)
+           .add(",\"n\":").addUInt(count)
+           .add(",\"now\":").addUInt(nowMs)
+           .add(",\"t0\":").addUInt(count ? samples[0].timestamp : 0)
+           .add(",\"dt\":[");
+        for (uint8_t i = 0; i < count; i++) {
+            uint32_t delta = (i == 0) ? 0 : samples[i].timestamp - samples[i - 1].timestamp;
+            out.add(i ? "," : "").addUInt(delta);
+        }
+        out.add("],\"temperature\":[");
+        for (uint8_t i = 0; i < count; i++) {
+            out.add(i ? "," : "").addCenti(samples[i].temperature);
+        }
+        out.add("],\"humidity\":[");
+        for (uint8_t i = 0; i < count; i++) {
+            out.add(i ? "," : "").addCenti(samples[i].humidity);
+        }
+        out.add("],\"pressure\":[");
+        for (uint8_t i = 0; i < count; i++) {
+            out.add(i ? "," : "").addCenti((int32_t)samples[i].pressure);
+        }
+        out.add("]}");
+    }
+
+    // Call after the batch went out: updates the statistics and empties it
+    void sent(uint32_t payloadLength, uint32_t nowMs) {
+        stats.batches++;
+        stats.samples += count;
+        stats.payloadBytes += payloadLength;
+        stats.wireBytes += payloadLength + BATCH_MESSAGE_OVERHEAD;
+        for (uint8_t i = 0; i < count; i++) {
+            uint32_t latency = nowMs - samples[i].timestamp;
+            stats.latencySumMs += latency;
+            if (latency > stats.maxLatencyMs) {
+                stats.maxLatencyMs = latency;
+            }
+        }
+        count = 0;
+    }
+};
+
+#endif // BATCH_PUBLISHER_H
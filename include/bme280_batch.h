@@ -0,0 +1,151 @@
+#ifndef BME280_BATCH_H
+#define BME280_BATCH_H
+
+// Batch compensation for buffered raw BME280 samples
+//
+// When replaying big captures of raw ADC words, compensating one sample at a
+// time wastes most of the CPU. These functions take the samples as a
+// structure of arrays (one array per channel) and run each channel in its own
+// tight loop, so the compiler can vectorize the 32-bit temperature and
+// humidity paths. The 64-bit pressure path has a division in it, so it stays
+// scalar, but it's branch-free and no longer interleaved with the others.
+//
+// The math is the same expressions as bme280_compensation.h, just rearranged,
+// so the results are bit-exact with the scalar kernel.
+
+#include <stddef.h>
+#include <stdint.h>
+#include "bme280_compensation.h"
+
+// How many samples we handle per block - the t_fine scratch array lives on
+// the stack, so this keeps it small and in L1
+#define BME280_BATCH_BLOCK 256
+
+#if defined(__GNUC__)
+#define BME280_RESTRICT __restrict__
+#else
+#define BME280_RESTRICT
+#endif
+
+// Structure-of-arrays view of raw samples (inputs)
+typedef struct {
+    const int32_t *adcTemp;
+    const int32_t *adcPres;
+    const int32_t *adcHum;
+} BME280_RawBatch;
+
+// Structure-of-arrays view of compensated samples (outputs)
+// Units are the same as BME280_CompensatedData
+typedef struct {
+    int32_t  *temperature;  // 0.01 °C
+    uint32_t *pressure;     // Pa in Q24.8
+    uint32_t *humidity;     // %RH in Q22.10
+} BME280_CompensatedBatch;
+
+// Temperature for a block - pure 32-bit integer math, vectorizes well
+inline void bme280CompensateTemperatureBlock(const BME280_CalibrationData &calib,
+                                             const int32_t *BME280_RESTRICT adcTemp,
+                                             int32_t *BME280_RESTRICT temperature,
+                                             int32_t *BME280_RESTRICT tFine,
+                                             size_t count) {
+    const int32_t t1 = calib.dig_T1;
+    const int32_t t2 = calib.dig_T2;
+    const int32_t t3 = calib.dig_T3;
+
+    for (size_t i = 0; i < count; i++) {
+        int32_t adc = adcTemp[i];
+        int32_t var1 = (((adc >> 3) - (t1 << 1)) * t2) >> 11;
+        int32_t d = (adc >> 4) - t1;
+        int32_t var2 = (((d * d) >> 12) * t3) >> 14;
+        int32_t fine = var1 + var2;
+        tFine[i] = fine;
+        temperature[i] = (fine * 5 + 128) >> 8;
+    }
+}
+
+// Humidity for a block - also 32-bit only, with the clamps written as selects
+inline void bme280CompensateHumidityBlock(const BME280_CalibrationData &calib,
+                                          const int32_t *BME280_RESTRICT adcHum,
+                                          const int32_t *BME280_RESTRICT tFine,
+                                          uint32_t *BME280_RESTRICT humidity,
+                                          size_t count) {
+    const int32_t h1 = calib.dig_H1;
+    const int32_t h2 = calib.dig_H2;
+    const int32_t h3 = calib.dig_H3;
+    const int32_t h4 = calib.dig_H4;
+    const int32_t h5 = calib.dig_H5;
+    const int32_t h6 = calib.dig_H6;
+
+    for (size_t i = 0; i < count; i++) {
+        int32_t v = tFine[i] - 76800;
+        int32_t a = (((adcHum[i] << 14) - (h4 << 20) - (h5 * v)) + 16384) >> 15;
+        int32_t b = (((((v * h6) >> 10) * (((v * h3) >> 11) + 32768)) >> 10) + 2097152) * h2 + 8192;
+        v = a * (b >> 14);
+        v = v - (((((v >> 15) * (v >> 15)) >> 7) * h1) >> 4);
+        v = (v < 0) ? 0 : v;
+        v = (v > 419430400) ? 419430400 : v;
+        humidity[i] = (uint32_t)(v >> 12);
+    }
+}
+
+// Pressure for a block - 64-bit math and a division, so it doesn't vectorize,
+// but the divide-by-zero guard is a select instead of an early return
+inline void bme280CompensatePressureBlock(const BME280_CalibrationData &calib,
+                                          const int32_t *BME280_RESTRICT adcPres,
+                                          const int32_t *BME280_RESTRICT tFine,
+                                          uint32_t *BME280_RESTRICT pressure,
+                                          size_t count) {
+    const int64_t p1 = calib.dig_P1;
+    const int64_t p2 = calib.dig_P2;
+    const int64_t p3 = calib.dig_P3;
+    const int64_t p4 = calib.dig_P4;
+    const int64_t p5 = calib.dig_P5;
+    const int64_t p6 = calib.dig_P6;
+    const int64_t p7 = calib.dig_P7;
+    const int64_t p8 = calib.dig_P8;
+    const int64_t p9 = calib.dig_P9;
+
+    for (size_t i = 0; i < count; i++) {
+        int64_t var1 = (int64_t)tFine[i] - 128000;
+        int64_t var2 = var1 * var1 * p6;
+        var2 = var2 + ((var1 * p5) << 17);
+        var2 = var2 + (p4 << 35);
+        var1 = ((var1 * var1 * p3) >> 8) + ((var1 * p2) << 12);
+        var1 = ((((int64_t)1) << 47) + var1) * p1 >> 33;
+
+        // Divide by 1 instead of 0 and throw the result away afterwards
+        int64_t divisor = (var1 == 0) ? 1 : var1;
+        int64_t p = 1048576 - adcPres[i];
+        p = (((p << 31) - var2) * 3125) / divisor;
+        int64_t v1 = (p9 * (p >> 13) * (p >> 13)) >> 25;
+        int64_t v2 = (p8 * p) >> 19;
+        p = ((p + v1 + v2) >> 8) + (p7 << 4);
+
+        pressure[i] = (var1 == 0) ? 0 : (uint32_t)p;
+    }
+}
+
+// Compensate 'count' samples. Each channel is processed block by block so the
+// t_fine values computed for temperature are reused by pressure and humidity
+inline void bme280CompensateBatch(const BME280_CalibrationData &calib,
+                                  const BME280_RawBatch &raw,
+                                  const BME280_CompensatedBatch &out,
+                                  size_t count) {
+    int32_t tFine[BME280_BATCH_BLOCK];
+
+    for (size_t start = 0; start < count; start += BME280_BATCH_BLOCK) {
+        size_t n = count - start;
+        if (n > BME280_BATCH_BLOCK) {
+            n = BME280_BATCH_BLOCK;
+        }
+
+        bme280CompensateTemperatureBlock(calib, raw.adcTemp + start,
+                                         out.temperature + start, tFine, n);
+        bme280CompensateHumidityBlock(calib, raw.adcHum + start, tFine,
+                                      out.humidity + start, n);
+        bme280CompensatePressureBlock(calib, raw.adcPres + start, tFine,
+                                      out.pressure + start, n);
+    }
+}
+
+#endif // BME280_BATCH_H
@@ -0,0 +1,157 @@
+#ifndef BME280_CALIBRATION_CACHE_H
+#define BME280_CALIBRATION_CACHE_H
+
+// Calibration cache for the BME280
+//
+// The calibration coefficients never change for a given chip, but reading them
+// on every boot costs a soft reset, waiting for the NVM copy and three more I2C
+// transactions. Instead we keep the parsed BME280_CalibrationData in a
+// persistent store, keyed by chip ID, bus and I2C address and protected by a CRC,
+// so a warm boot can go straight to configuring the sensor.
+//
+// The record format and the store interface are plain C++ so they work on the
+// ESP32 (NVS, see bme280_nvs_store.h) and in the native simulator (a file).
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "bme280_compensation.h"
+
+#define BME280_CALIB_MAGIC     0x42434131UL  // "BCA1"
+#define BME280_CALIB_VERSION   1             // Bump if the record layout changes
+
+// What actually gets stored - the CRC covers every byte before it
+typedef struct {
+    uint32_t magic;
+    uint8_t  version;
+    uint8_t  chipId;
+    uint8_t  address;
+    uint8_t  bus;      // Which I2C bus (0 = Wire, 1 = Wire1, ...)
+    BME280_CalibrationData calib;
+    uint16_t crc;
+} BME280_CalibrationRecord;
+
+// CRC-16/CCITT (poly 0x1021, init 0xFFFF) - small and good enough to catch
+// a half-written or corrupted record
+inline uint16_t bme280Crc16(const uint8_t *data, size_t length) {
+    uint16_t crc = 0xFFFF;
+    for (size_t i = 0; i < length; i++) {
+        crc ^= (uint16_t)data[i] << 8;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+        }
+    }
+    return crc;
+}
+
+inline uint16_t bme280CalibrationRecordCrc(const BME280_CalibrationRecord &record) {
+    return bme280Crc16((const uint8_t *)&record, offsetof(BME280_CalibrationRecord, crc));
+}
+
+// Build a record ready to be written. It's zeroed first so the padding
+// bytes inside the struct don't make the CRC random
+inline BME280_CalibrationRecord bme280MakeCalibrationRecord(uint8_t chipId, uint8_t bus, uint8_t address,
+                                                            const BME280_CalibrationData &calib) {
+    BME280_CalibrationRecord record;
+    memset(&record, 0, sizeof(record));
+    record.magic = BME280_CALIB_MAGIC;
+    record.version = BME280_CALIB_VERSION;
+    record.chipId = chipId;
+    record.address = address;
+    record.bus = bus;
+    record.calib = calib;
+    record.crc = bme280CalibrationRecordCrc(record);
+    return record;
+}
+
+// True if the record is intact and belongs to this chip/bus/address
+inline bool bme280CheckCalibrationRecord(const BME280_CalibrationRecord &record,
+                                         uint8_t chipId, uint8_t bus, uint8_t address) {
+    return record.magic == BME280_CALIB_MAGIC &&
+           record.version == BME280_CALIB_VERSION &&
+           record.chipId == chipId &&
+           record.address == address &&
+           record.bus == bus &&
+           record.crc == bme280CalibrationRecordCrc(record);
+}
+
+// Where cached records live. Implementations only move raw records around,
+// all the checking is done here so every store behaves the same way
+class BME280_CalibrationStore {
+public:
+    virtual ~BME280_CalibrationStore() {}
+
+    // Fetch the cached calibration, returns false on a miss or a bad record
+    bool load(uint8_t chipId, uint8_t address, BME280_CalibrationData &calib, uint8_t bus = 0) {
+        BME280_CalibrationRecord record;
+        if (!readRecord(bus, address, record) ||
+            !bme280CheckCalibrationRecord(record, chipId, bus, address)) {
+            misses++;
+            return false;
+        }
+        calib = record.calib;
+        hits++;
+        return true;
+    }
+
+    bool save(uint8_t chipId, uint8_t address, const BME280_CalibrationData &calib, uint8_t bus = 0) {
+        return writeRecord(bus, address, bme280MakeCalibrationRecord(chipId, bus, address, calib));
+    }
+
+    uint32_t hits = 0;    // Loads that found a valid record
+    uint32_t misses = 0;  // Loads that had to fall back to the sensor
+    uint32_t stale = 0;   // Hits the driver threw away: the sensor had been replaced
+
+protected:
+    // One record slot per bus and I2C address
+    virtual bool readRecord(uint8_t bus, uint8_t address, BME280_CalibrationRecord &record) = 0;
+    virtual bool writeRecord(uint8_t bus, uint8_t address, const BME280_CalibrationRecord &record) = 0;
+};
+
+#ifdef SIMULATION_MODE
+#include <cstdio>
+#include <string>
+
+// Native store: one small binary file per slot, e.g. "<prefix>_76.bin" for
+// bus 0 and "<prefix>_1_76.bin" for the others
+class BME280_FileCalibrationStore : public BME280_CalibrationStore {
+public:
+    explicit BME280_FileCalibrationStore(const std::string &prefix) : prefix(prefix) {}
+
+    std::string pathFor(uint8_t address, uint8_t bus = 0) const {
+        char suffix[16];
+        if (bus == 0) {
+            snprintf(suffix, sizeof(suffix), "_%02x.bin", address);
+        } else {
+            snprintf(suffix, sizeof(suffix), "_%u_%02x.bin", bus, address);
+        }
+        return prefix + suffix;
+    }
+
+protected:
+    bool readRecord(uint8_t bus, uint8_t address, BME280_CalibrationRecord &record) override {
+        FILE *file = fopen(pathFor(address, bus).c_str(), "rb");
+        if (!file) {
+            return false;
+        }
+        bool ok = fread(&record, sizeof(record), 1, file) == 1;
+        fclose(file);
+        return ok;
+    }
+
+    bool writeRecord(uint8_t bus, uint8_t address, const BME280_CalibrationRecord &record) override {
+        FILE *file = fopen(pathFor(address, bus).c_str(), "wb");
+        if (!file) {
+            return false;
+        }
+        bool ok = fwrite(&record, sizeof(record), 1, file) == 1;
+        fclose(file);
+        return ok;
+    }
+
+private:
+    std::string prefix;
+};
+#endif // SIMULATION_MODE
+
+#endif // BME280_CALIBRATION_CACHE_H
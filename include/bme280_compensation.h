@@ -0,0 +1,164 @@
+#ifndef BME280_COMPENSATION_H
+#define BME280_COMPENSATION_H
+
+// BME280 compensation kernel
+//
+// These are the integer compensation formulas from the Bosch BME280 datasheet
+// (section 4.2.3 and 8.2), pulled out of the driver so they don't depend on
+// Wire or any Arduino headers. Everything here is stateless: t_fine is passed
+// in and out explicitly instead of living in the driver object.
+// That means the same code runs on the ESP32 and on the native simulator,
+// where it can be benchmarked and checked against the datasheet values.
+
+#include <stdint.h>
+
+// This structure holds all the calibration coefficients for the BME280
+// Each sensor has unique values that we have to read from its memory
+// We'll use these values in complex formulas from the datasheet
+typedef struct {
+    // Temperature compensation values
+    uint16_t dig_T1;  // Always positive
+    int16_t  dig_T2;  // Can be negative
+    int16_t  dig_T3;  // Can be negative
+
+    // Pressure compensation values
+    uint16_t dig_P1;  // Always positive
+    int16_t  dig_P2;  // Can be negative
+    int16_t  dig_P3;  // Can be negative
+    int16_t  dig_P4;  // Can be negative
+    int16_t  dig_P5;  // Can be negative
+    int16_t  dig_P6;  // Can be negative
+    int16_t  dig_P7;  // Can be negative
+    int16_t  dig_P8;  // Can be negative
+    int16_t  dig_P9;  // Can be negative
+
+    // Humidity compensation values
+    uint8_t  dig_H1;  // Always positive
+    int16_t  dig_H2;  // Can be negative
+    uint8_t  dig_H3;  // Always positive
+    int16_t  dig_H4;  // Can be negative, stored weird
+    int16_t  dig_H5;  // Can be negative, stored weird
+    int8_t   dig_H6;  // Can be negative
+} BME280_CalibrationData;
+
+// Raw 20-bit (T, P) and 16-bit (H) ADC words as they come out of 0xF7-0xFE
+typedef struct {
+    int32_t adcTemp;
+    int32_t adcPres;
+    int32_t adcHum;
+} BME280_RawData;
+
+// Compensated values in the datasheet's native integer formats
+typedef struct {
+    int32_t  temperature;  // 0.01 °C (5123 = 51.23 °C)
+    uint32_t pressure;     // Pa in Q24.8 (24674867 = 96386.2 Pa)
+    uint32_t humidity;     // %RH in Q22.10 (47445 = 46.333 %RH)
+    int32_t  t_fine;       // Fine temperature, needed by P and H
+} BME280_CompensatedData;
+
+// The same sample in plain decimal fixed point, ready for display and JSON
+// Every field is in hundredths of the unit we show, so printing one is just
+// "integer part, dot, two digits" - no float anywhere (see fixed_format.h)
+typedef struct {
+    int32_t  temperature;  // 0.01 °C (2350 = 23.50 °C)
+    uint32_t pressure;     // Pa, which is 0.01 hPa (101325 = 1013.25 hPa)
+    uint32_t humidity;     // 0.01 %RH (4533 = 45.33 %RH)
+} BME280_FixedData;
+
+// Unpack the 8-byte burst from 0xF7 (press, temp, hum - in that order)
+inline BME280_RawData bme280ParseRawData(const uint8_t *buffer) {
+    BME280_RawData raw;
+    raw.adcPres = ((uint32_t)buffer[0] << 12) | ((uint32_t)buffer[1] << 4) | (buffer[2] >> 4);
+    raw.adcTemp = ((uint32_t)buffer[3] << 12) | ((uint32_t)buffer[4] << 4) | (buffer[5] >> 4);
+    raw.adcHum  = ((uint32_t)buffer[6] << 8) | buffer[7];
+    return raw;
+}
+
+// Temperature compensation formula from BME280 datasheet
+// Returns 0.01 °C and writes the fine temperature to tFine
+inline int32_t bme280CompensateTemperature(const BME280_CalibrationData &calib,
+                                           int32_t adcTemp, int32_t &tFine) {
+    int32_t var1, var2;
+
+    var1 = ((((adcTemp >> 3) - ((int32_t)calib.dig_T1 << 1))) *
+            ((int32_t)calib.dig_T2)) >> 11;
+
+    var2 = (((((adcTemp >> 4) - ((int32_t)calib.dig_T1)) *
+              ((adcTemp >> 4) - ((int32_t)calib.dig_T1))) >> 12) *
+            ((int32_t)calib.dig_T3)) >> 14;
+
+    tFine = var1 + var2;
+    return (tFine * 5 + 128) >> 8;
+}
+
+// Pressure compensation formula from BME280 datasheet (64-bit version)
+// Returns Pa in Q24.8, or 0 if the calibration would divide by zero
+inline uint32_t bme280CompensatePressure(const BME280_CalibrationData &calib,
+                                         int32_t adcPres, int32_t tFine) {
+    int64_t var1, var2, p;
+
+    var1 = ((int64_t)tFine) - 128000;
+    var2 = var1 * var1 * (int64_t)calib.dig_P6;
+    var2 = var2 + ((var1 * (int64_t)calib.dig_P5) << 17);
+    var2 = var2 + (((int64_t)calib.dig_P4) << 35);
+    var1 = ((var1 * var1 * (int64_t)calib.dig_P3) >> 8) +
+           ((var1 * (int64_t)calib.dig_P2) << 12);
+    var1 = (((((int64_t)1) << 47) + var1)) * ((int64_t)calib.dig_P1) >> 33;
+
+    if (var1 == 0) {
+        return 0; // Avoid division by zero
+    }
+
+    p = 1048576 - adcPres;
+    p = (((p << 31) - var2) * 3125) / var1;
+    var1 = (((int64_t)calib.dig_P9) * (p >> 13) * (p >> 13)) >> 25;
+    var2 = (((int64_t)calib.dig_P8) * p) >> 19;
+
+    p = ((p + var1 + var2) >> 8) + (((int64_t)calib.dig_P7) << 4);
+    return (uint32_t)p;
+}
+
+// Humidity compensation formula from BME280 datasheet
+// Returns %RH in Q22.10
+inline uint32_t bme280CompensateHumidity(const BME280_CalibrationData &calib,
+                                         int32_t adcHum, int32_t tFine) {
+    int32_t v_x1_u32r;
+
+    v_x1_u32r = (tFine - ((int32_t)76800));
+
+    v_x1_u32r = (((((adcHum << 14) - (((int32_t)calib.dig_H4) << 20) -
+                   (((int32_t)calib.dig_H5) * v_x1_u32r)) + ((int32_t)16384)) >> 15) *
+                (((((((v_x1_u32r * ((int32_t)calib.dig_H6)) >> 10) *
+                   (((v_x1_u32r * ((int32_t)calib.dig_H3)) >> 11) + ((int32_t)32768))) >> 10) +
+                   ((int32_t)2097152)) * ((int32_t)calib.dig_H2) + 8192) >> 14));
+
+    v_x1_u32r = (v_x1_u32r - (((((v_x1_u32r >> 15) * (v_x1_u32r >> 15)) >> 7) *
+                             ((int32_t)calib.dig_H1)) >> 4));
+
+    v_x1_u32r = (v_x1_u32r < 0) ? 0 : v_x1_u32r;
+    v_x1_u32r = (v_x1_u32r > 419430400) ? 419430400 : v_x1_u32r;
+
+    return (uint32_t)(v_x1_u32r >> 12);
+}
+
+// Compensate a full sample - temperature first, then P and H from its t_fine
+inline BME280_CompensatedData bme280Compensate(const BME280_CalibrationData &calib,
+                                               const BME280_RawData &raw) {
+    BME280_CompensatedData out;
+    out.temperature = bme280CompensateTemperature(calib, raw.adcTemp, out.t_fine);
+    out.pressure = bme280CompensatePressure(calib, raw.adcPres, out.t_fine);
+    out.humidity = bme280CompensateHumidity(calib, raw.adcHum, out.t_fine);
+    return out;
+}
+
+// Convert the datasheet formats to hundredths, rounding to nearest
+// Q24.8 Pa -> Pa, and Q22.10 %RH -> 0.01 %RH (fits easily, 100 %RH * 100 < 2^24)
+inline BME280_FixedData bme280ToFixed(const BME280_CompensatedData &comp) {
+    BME280_FixedData out;
+    out.temperature = comp.temperature;
+    out.pressure = (comp.pressure + 128) >> 8;
+    out.humidity = (comp.humidity * 100 + 512) >> 10;
+    return out;
+}
+
+#endif // BME280_COMPENSATION_H
@@ -0,0 +1,348 @@
+#ifndef BME280_EMULATOR_H
+#define BME280_EMULATOR_H
+
+// Register-level BME280 emulator for the native build
+//
+// This models the chip the way the driver sees it over I2C: the register map,
+// the calibration NVM (including the odd H4/H5 packing), the status bits
+// (im_update during the NVM copy after reset, measuring during a conversion),
+// forced/normal mode with datasheet conversion times, and shadowed data
+// registers that only change when a conversion finishes.
+//
+// BME280_EmulatedTransport puts one or two of these on a simulated I2C bus.
+// Time is simulated too: every transaction advances the clock by the time it
+// would take on the wire, and delayMs() just moves the clock forward. That way
+// the real driver code can run (and be benchmarked) on Linux with exact
+// transaction counts and bus-time accounting.
+
+#include <stdint.h>
+#include <string.h>
+#include "bme280_compensation.h"
+#include "bme280_transport.h"
+
+class BME280_Emulator {
+public:
+    // Timing knobs, in microseconds
+    uint32_t nvmCopyUs = 1000;  // How long im_update stays set after a reset
+
+    explicit BME280_Emulator(uint8_t address = 0x76) : address(address) {
+        calib = {27504, 26435, -1000,
+                 36477, -10685, 3024, 2855, 140, -7, 15500, -14600, 6000,
+                 75, 362, 0, 313, 50, 30};
+        setEnvironment(22.0f, 50.0f, 1013.25f);
+        powerOn(0);
+    }
+
+    uint8_t getAddress() const { return address; }
+
+    // Calibration burnt into this chip's NVM (takes effect at the next reset)
+    void setCalibration(const BME280_CalibrationData &c) { calib = c; }
+    const BME280_CalibrationData &getCalibration() const { return calib; }
+
+    // Physical conditions the next conversion will "measure"
+    void setEnvironment(float temperature, float humidity, float pressure) {
+        raw = encodeRaw(calib, temperature, humidity, pressure);
+    }
+
+    // Cold power-on at the given time: registers cleared, NVM copy running
+    void powerOn(uint64_t nowUs) {
+        memset(regs, 0, sizeof(regs));
+        regs[0xD0] = 0x60;  // Chip ID
+        regs[0xF7] = 0x80;  // Data registers read 0x80000 / 0x8000 until the first conversion
+        regs[0xFA] = 0x80;
+        regs[0xFD] = 0x80;
+        humOsrLatched = 0;
+        measuring = false;
+        nextConversionUs = 0;
+        nvmDoneUs = nowUs + nvmCopyUs;
+        loadNvm();
+    }
+
+    // --- Bus side, called by the transport ---
+
+    void write(uint8_t reg, uint8_t value, uint64_t nowUs) {
+        update(nowUs);
+
+        if (reg == 0xE0) {
+            if (value == 0xB6) {
+                powerOn(nowUs);  // Soft reset behaves like power-on
+            }
+            return;
+        }
+        if (reg != 0xF2 && reg != 0xF4 && reg != 0xF5) {
+            return;  // Everything else is read-only
+        }
+        regs[reg] = value;
+
+        if (reg == 0xF4) {
+            // ctrl_hum only takes effect after a write to ctrl_meas
+            humOsrLatched = regs[0xF2] & 0x07;
+
+            uint8_t mode = value & 0x03;
+            if (mode == 0x01 || mode == 0x02) {
+                startConversion(nowUs);  // Forced mode
+            } else if (mode == 0x03) {
+                if (!measuring) {
+                    startConversion(nowUs);  // Normal mode starts right away
+                }
+            } else {
+                measuring = false;  // Sleep aborts a normal-mode cycle
+                nextConversionUs = 0;
+            }
+        }
+    }
+
+    void read(uint8_t reg, uint8_t *buffer, uint8_t length, uint64_t nowUs) {
+        update(nowUs);
+        for (uint8_t i = 0; i < length; i++) {
+            uint8_t r = (uint8_t)(reg + i);  // Auto-increment
+            buffer[i] = (r == 0xF3) ? statusByte(nowUs) : regs[r];
+        }
+    }
+
+    // Typical conversion time for the current settings (datasheet 9.1)
+    uint32_t conversionTimeUs() const {
+        uint32_t t = samples((regs[0xF4] >> 5) & 0x07);
+        uint32_t p = samples((regs[0xF4] >> 2) & 0x07);
+        uint32_t h = samples(humOsrLatched);
+        uint32_t time = 1000 + 2000 * t;
+        if (p) time += 2000 * p + 500;
+        if (h) time += 2000 * h + 500;
+        return time;
+    }
+
+    uint32_t conversions = 0;  // Completed measurements (for tests and benchmarks)
+
+    // Turn physical values into the raw ADC words that would produce them.
+    // All three compensation curves are monotonic, so a binary search over
+    // the ADC range is enough to "invert" them
+    static BME280_RawData encodeRaw(const BME280_CalibrationData &calib,
+                                    float temperature, float humidity, float pressure) {
+        BME280_RawData r;
+        int32_t tFine;
+
+        r.adcTemp = searchAdc(0xFFFFF, (int64_t)(temperature * 100.0f), true, [&](int32_t adc) {
+            int32_t f;
+            return (int64_t)bme280CompensateTemperature(calib, adc, f);
+        });
+        bme280CompensateTemperature(calib, r.adcTemp, tFine);
+
+        // Higher pressure means a lower ADC word, so this curve goes downwards
+        r.adcPres = searchAdc(0xFFFFF, (int64_t)(pressure * 100.0f * 256.0f), false, [&](int32_t adc) {
+            return (int64_t)bme280CompensatePressure(calib, adc, tFine);
+        });
+        r.adcHum = searchAdc(0xFFFF, (int64_t)(humidity * 1024.0f), true, [&](int32_t adc) {
+            return (int64_t)bme280CompensateHumidity(calib, adc, tFine);
+        });
+        return r;
+    }
+
+private:
+    uint8_t address;
+    uint8_t regs[256];
+    BME280_CalibrationData calib;
+    BME280_RawData raw;
+
+    uint8_t humOsrLatched;       // osrs_h actually in use
+    bool measuring;
+    uint64_t conversionDoneUs;   // When the running conversion finishes
+    uint64_t nextConversionUs;   // Normal mode: when the next one starts
+    uint64_t nvmDoneUs;          // When the NVM copy after reset finishes
+
+    template <typename Compensate>
+    static int32_t searchAdc(int32_t maxAdc, int64_t target, bool increasing, Compensate compensate) {
+        int32_t lo = 0, hi = maxAdc;
+        while (lo < hi) {
+            int32_t mid = lo + (hi - lo) / 2;
+            int64_t value = compensate(mid);
+            bool reached = increasing ? (value >= target) : (value <= target);
+            if (reached) {
+                hi = mid;
+            } else {
+                lo = mid + 1;
+            }
+        }
+        return lo;
+    }
+
+    static uint32_t samples(uint8_t osr) {
+        if (osr == 0) return 0;
+        return 1u << ((osr > 5 ? 5 : osr) - 1);
+    }
+
+    // Status: bit 3 = measuring, bit 0 = im_update (NVM copy in progress)
+    uint8_t statusByte(uint64_t nowUs) const {
+        return (measuring ? 0x08 : 0x00) | (nowUs < nvmDoneUs ? 0x01 : 0x00);
+    }
+
+    // Copy the calibration into the image registers, packed like the real chip
+    void loadNvm() {
+        const uint16_t tp[12] = {calib.dig_T1, (uint16_t)calib.dig_T2, (uint16_t)calib.dig_T3,
+                                 calib.dig_P1, (uint16_t)calib.dig_P2, (uint16_t)calib.dig_P3,
+                                 (uint16_t)calib.dig_P4, (uint16_t)calib.dig_P5, (uint16_t)calib.dig_P6,
+                                 (uint16_t)calib.dig_P7, (uint16_t)calib.dig_P8, (uint16_t)calib.dig_P9};
+        for (int i = 0; i < 12; i++) {
+            regs[0x88 + 2 * i] = tp[i] & 0xFF;
+            regs[0x89 + 2 * i] = tp[i] >> 8;
+        }
+        regs[0xA1] = calib.dig_H1;
+        regs[0xE1] = (uint16_t)calib.dig_H2 & 0xFF;
+        regs[0xE2] = (uint16_t)calib.dig_H2 >> 8;
+        regs[0xE3] = calib.dig_H3;
+        regs[0xE4] = (uint8_t)(calib.dig_H4 >> 4);
+        regs[0xE5] = (uint8_t)((calib.dig_H4 & 0x0F) | ((calib.dig_H5 & 0x0F) << 4));
+        regs[0xE6] = (uint8_t)(calib.dig_H5 >> 4);
+        regs[0xE7] = (uint8_t)calib.dig_H6;
+    }
+
+    void startConversion(uint64_t nowUs) {
+        measuring = true;
+        conversionDoneUs = nowUs + conversionTimeUs();
+    }
+
+    // Standby time in normal mode (t_sb field of config)
+    uint32_t standbyUs() const {
+        static const uint32_t table[8] = {500, 62500, 125000, 250000, 500000, 1000000, 10000, 20000};
+        return table[(regs[0xF5] >> 5) & 0x07];
+    }
+
+    // Move the chip's state forward to 'nowUs'
+    void update(uint64_t nowUs) {
+        // Normal mode may have started new cycles while nobody was looking
+        while (true) {
+            if (measuring && nowUs >= conversionDoneUs) {
+                finishConversion();
+                if ((regs[0xF4] & 0x03) == 0x03) {
+                    nextConversionUs = conversionDoneUs + standbyUs();
+                } else {
+                    regs[0xF4] &= ~0x03;  // Forced mode drops back to sleep
+                }
+            } else if (!measuring && (regs[0xF4] & 0x03) == 0x03 &&
+                       nextConversionUs != 0 && nowUs >= nextConversionUs) {
+                measuring = true;
+                conversionDoneUs = nextConversionUs + conversionTimeUs();
+            } else {
+                break;
+            }
+        }
+    }
+
+    // Latch the results into the data registers (the "shadow" update)
+    void finishConversion() {
+        measuring = false;
+        conversions++;
+
+        uint8_t osrT = (regs[0xF4] >> 5) & 0x07;
+        uint8_t osrP = (regs[0xF4] >> 2) & 0x07;
+        int32_t t = osrT ? raw.adcTemp : 0x80000;
+        int32_t p = osrP ? raw.adcPres : 0x80000;
+        int32_t h = humOsrLatched ? raw.adcHum : 0x8000;
+
+        regs[0xF7] = (p >> 12) & 0xFF;
+        regs[0xF8] = (p >> 4) & 0xFF;
+        regs[0xF9] = (p << 4) & 0xF0;
+        regs[0xFA] = (t >> 12) & 0xFF;
+        regs[0xFB] = (t >> 4) & 0xFF;
+        regs[0xFC] = (t << 4) & 0xF0;
+        regs[0xFD] = (h >> 8) & 0xFF;
+        regs[0xFE] = h & 0xFF;
+    }
+};
+
+// Simulated I2C bus with up to two emulated BME280s on it
+class BME280_EmulatedTransport : public BME280_Transport {
+public:
+    // Bus statistics
+    uint32_t transactions = 0;
+    uint32_t bytesTransferred = 0;  // Address, register and data bytes
+    uint64_t busTimeUs = 0;         // Time the bus was busy
+    uint32_t nakCount = 0;          // Test knob: NAK this many of the next transactions
+
+    explicit BME280_EmulatedTransport(uint32_t clockHz = 100000) : clockHz(clockHz) {
+        devices[0] = devices[1] = nullptr;
+    }
+
+    // Several buses driven by one CPU share one clock: a delay or a
+    // transaction on either of them moves time forward for both
+    void shareClockWith(BME280_EmulatedTransport &other) { clock = other.clock; }
+
+    void attach(BME280_Emulator *device) {
+        for (int i = 0; i < 2; i++) {
+            if (!devices[i]) {
+                devices[i] = device;
+                return;
+            }
+        }
+    }
+
+    bool writeRegister(uint8_t address, uint8_t reg, uint8_t value) override {
+        // addr+W, reg, value
+        BME280_Emulator *device = find(address);
+        account(3);
+        if (!device || nak()) return false;
+        device->write(reg, value, *clock);
+        return true;
+    }
+
+    bool readRegisters(uint8_t address, uint8_t reg, uint8_t *buffer, uint8_t length) override {
+        // addr+W, reg, (repeated start) addr+R, data...
+        BME280_Emulator *device = find(address);
+        account(3 + length);
+        if (!device || nak()) {
+            memset(buffer, 0xFF, length);  // Nobody drives SDA - reads as all ones
+            return false;
+        }
+        device->read(reg, buffer, length, *clock);
+        return true;
+    }
+
+    bool probe(uint8_t address) override {
+        account(1);
+        return find(address) != nullptr;
+    }
+
+    uint32_t millis() override { return (uint32_t)(*clock / 1000); }
+    void delayMs(uint32_t ms) override { *clock += (uint64_t)ms * 1000; }
+
+    uint64_t micros() const { return *clock; }
+    void resetStats() {
+        transactions = 0;
+        bytesTransferred = 0;
+        busTimeUs = 0;
+    }
+
+private:
+    uint32_t clockHz;
+    uint64_t ownClock = 0;
+    uint64_t *clock = &ownClock;  // Simulated time in microseconds
+    BME280_Emulator *devices[2];
+
+    bool nak() {
+        if (nakCount == 0) {
+            return false;
+        }
+        nakCount--;
+        return true;
+    }
+
+    BME280_Emulator *find(uint8_t address) {
+        for (int i = 0; i < 2; i++) {
+            if (devices[i] && devices[i]->getAddress() == address) {
+                return devices[i];
+            }
+        }
+        return nullptr;
+    }
+
+    // Each byte is 9 clocks (8 data + ACK), plus start/stop conditions
+    void account(uint32_t bytes) {
+        transactions++;
+        bytesTransferred += bytes;
+        uint64_t bits = (uint64_t)bytes * 9 + 3;
+        uint64_t us = (bits * 1000000 + clockHz - 1) / clockHz;
+        busTimeUs += us;
+        *clock += us;  // The caller is blocked while the bus is busy
+    }
+};
+
+#endif // BME280_EMULATOR_H
@@ -0,0 +1,34 @@
+#ifndef BME280_TRANSPORT_H
+#define BME280_TRANSPORT_H
+
+// Bus transport used by the BME280 driver
+//
+// The driver used to talk to TwoWire directly, which meant it could only run
+// on the ESP32. Now everything it needs from the outside world goes through
+// this small interface: register reads/writes, an address probe, and the
+// clock (millis/delay). On the ESP32 that's BME280_TwoWireTransport; on the
+// native build it's BME280_EmulatedTransport (bme280_emulator.h), which runs a
+// register-level model of the chip with simulated time.
+
+#include <stdint.h>
+
+class BME280_Transport {
+public:
+    virtual ~BME280_Transport() {}
+
+    // Write one register: START, addr+W, reg, value, STOP
+    virtual bool writeRegister(uint8_t address, uint8_t reg, uint8_t value) = 0;
+
+    // Burst read: START, addr+W, reg, repeated START, addr+R, length bytes, STOP
+    // The BME280 auto-increments the register address during the read
+    virtual bool readRegisters(uint8_t address, uint8_t reg, uint8_t *buffer, uint8_t length) = 0;
+
+    // True if a device ACKs at this address (address-only write)
+    virtual bool probe(uint8_t address) = 0;
+
+    // Clock - real time on the ESP32, simulated time on the emulator
+    virtual uint32_t millis() = 0;
+    virtual void delayMs(uint32_t ms) = 0;
+};
+
+#endif // BME280_TRANSPORT_H
@@ -0,0 +1,170 @@
+#ifndef COMMAND_TABLE_H
+#define COMMAND_TABLE_H
+
+// Command dispatch for the MQTT command topic
+//
+// The callback used to copy the payload into a variable-length array on the
+// stack (a big payload could blow the stack) and then walk a chain of strcmp()
+// calls, one per command. Now commands are registered once in setup() with a
+// handler, and dispatch() does this:
+//
+// - Copies the payload into a fixed buffer; anything longer than
+//   COMMAND_MAX_LENGTH is rejected instead of copied
+// - Splits it into the command name and its arguments ("SET_INTERVAL 500")
+// - Hashes the name's length and its first and last character (FNV-1a over
+//   those three bytes, like gperf picks a few key positions) and looks at the
+//   one slot of a small table that name can be in, so it costs the same
+//   whether there are 3 commands or 15, and doesn't depend on long names
+// - Tells the caller which display regions the command changed, so only
+//   those get redrawn
+//
+// commandHash() and commandSlot() are constexpr, and COMMAND_HASH_SHIFT is
+// picked so that the firmware's commands all land in different slots - a
+// perfect hash, checked with commandSlotsUnique() in a static_assert next to
+// the command list. There's no probing: a lookup is one slot and one
+// compare. A name that lands in a taken slot is refused by add(), so a new
+// command that breaks this fails the static_assert (or add() in the bench)
+// No heap is used anywhere - the table and the buffer are plain arrays.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#define COMMAND_TABLE_SIZE    32     // Slots (power of two)
+#define COMMAND_HASH_SHIFT    24     // Hash bits used for the slot (no collisions for main.cpp's commands)
+#define COMMAND_MAX_LENGTH    64     // Longest payload we accept, without the NUL
+
+// Handlers get everything after the first space ("" if there's nothing) and
+// return false when the arguments don't make sense
+typedef bool (*CommandHandler)(const char *args);
+
+typedef enum {
+    COMMAND_OK,          // Found and the handler accepted it
+    COMMAND_BAD_ARGS,    // Found, but the handler rejected the arguments
+    COMMAND_UNKNOWN,     // No such command
+    COMMAND_TOO_LONG     // Payload longer than COMMAND_MAX_LENGTH, ignored
+} CommandResult;
+
+// The command name is everything up to the first space or the NUL. These are
+// written as single expressions so they work as C++11 constexpr too
+constexpr size_t commandNameLength(const char *text, size_t n = 0) {
+    return (text[n] == '\0' || text[n] == ' ') ? n : commandNameLength(text, n + 1);
+}
+
+constexpr uint32_t commandHashStep(uint32_t hash, uint8_t byte) {
+    return (hash ^ byte) * 16777619u;
+}
+
+// 32-bit FNV-1a over the name's length, first and last character
+constexpr uint32_t commandHashOf(const char *name, size_t length) {
+    return length == 0 ? 2166136261u
+         : commandHashStep(commandHashStep(commandHashStep(2166136261u, (uint8_t)length),
+                                           (uint8_t)name[0]), (uint8_t)name[length - 1]);
+}
+
+constexpr uint32_t commandHash(const char *name) {
+    return commandHashOf(name, commandNameLength(name));
+}
+
+constexpr uint8_t commandSlot(uint32_t hash) {
+    return (uint8_t)((hash >> COMMAND_HASH_SHIFT) & (COMMAND_TABLE_SIZE - 1));
+}
+
+// A command as it's registered: name (a string literal), handler, and a bit
+// mask the caller defines for which parts of the screen the command changes
+typedef struct {
+    const char *name;
+    CommandHandler handler;
+    uint8_t regions;
+} CommandSpec;
+
+// True if no two of the first 'count' commands share a slot, for a
+// static_assert on a constexpr CommandSpec list (C++11: recursion, no loops)
+constexpr bool commandSlotsUnique(const CommandSpec *specs, size_t count, size_t i = 0, size_t j = 1) {
+    return i + 1 >= count ? true
+         : j >= count ? commandSlotsUnique(specs, count, i + 1, i + 2)
+         : commandSlot(commandHash(specs[i].name)) != commandSlot(commandHash(specs[j].name)) &&
+           commandSlotsUnique(specs, count, i, j + 1);
+}
+
+class CommandTable {
+private:
+    typedef struct {
+        const char *name;        // nullptr = empty slot (names must be string literals)
+        size_t length;
+        CommandHandler handler;
+        uint8_t regions;         // What to redraw after the command ran
+    } Entry;
+
+    Entry entries[COMMAND_TABLE_SIZE];
+    uint8_t count;
+    char message[COMMAND_MAX_LENGTH + 1];
+
+public:
+    // Statistics
+    uint32_t dispatched = 0;
+    uint32_t rejected = 0;    // Unknown, too long or bad arguments
+
+    CommandTable() : count(0) {
+        memset(entries, 0, sizeof(entries));
+        message[0] = '\0';
+    }
+
+    // Register a command. 'regions' is a bit mask the caller defines (which
+    // parts of the screen the command changes). Returns false if another
+    // command already has its slot
+    bool add(const char *name, CommandHandler handler, uint8_t regions = 0) {
+        Entry &entry = entries[commandSlot(commandHash(name))];
+        if (entry.name || !handler) {
+            return false;
+        }
+        entry.name = name;
+        entry.length = strlen(name);
+        entry.handler = handler;
+        entry.regions = regions;
+        count++;
+        return true;
+    }
+    bool add(const CommandSpec &spec) { return add(spec.name, spec.handler, spec.regions); }
+
+    uint8_t size() const { return count; }
+
+    // Run the command in 'payload' (not NUL-terminated, straight from MQTT)
+    // 'regions' is set to what needs redrawing - 0 unless the command worked
+    CommandResult dispatch(const uint8_t *payload, size_t length, uint8_t &regions) {
+        regions = 0;
+        if (length > COMMAND_MAX_LENGTH) {
+            message[0] = '\0';
+            rejected++;
+            return COMMAND_TOO_LONG;
+        }
+        memcpy(message, payload, length);
+        message[length] = '\0';
+
+        size_t nameLength = 0;
+        while (message[nameLength] != '\0' && message[nameLength] != ' ') {
+            nameLength++;
+        }
+        const char *args = message + nameLength + (message[nameLength] == ' ' ? 1 : 0);
+
+        // The only slot it can be in - confirm it's the same name
+        const Entry *entry = &entries[commandSlot(commandHashOf(message, nameLength))];
+        if (!entry->name || entry->length != nameLength || memcmp(entry->name, message, nameLength) != 0) {
+            rejected++;
+            return COMMAND_UNKNOWN;
+        }
+
+        dispatched++;
+        if (!entry->handler(args)) {
+            rejected++;
+            return COMMAND_BAD_ARGS;
+        }
+        regions = entry->regions;
+        return COMMAND_OK;
+    }
+
+    // The last payload, NUL-terminated (empty if it was too long) - for logging
+    const char *lastMessage() const { return message; }
+};
+
+#endif // COMMAND_TABLE_H
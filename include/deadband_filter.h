@@ -0,0 +1,87 @@
+#ifndef DEADBAND_FILTER_H
+#define DEADBAND_FILTER_H
+
+// Report-by-exception for sensor samples
+//
+// In a stable room the readings barely move, but we used to publish every
+// single one. With the deadband filter a sample is only passed on when at
+// least one channel has moved by more than its deadband since the last sample
+// we *reported* (not the last one we saw, so a slow drift still gets through
+// eventually), or when the heartbeat interval has passed without a report -
+// that way the receiver can still tell "stable" from "dead".
+//
+// A change is reported only when it's strictly more than the deadband, so
+// the invariant is: at any time, the last reported value of every channel is
+// within its deadband of the real one, and never older than the heartbeat.
+
+#include <stdint.h>
+#include "sample_buffer.h"
+
+// Defaults, all in the same units as BufferedSample
+#define DEADBAND_TEMPERATURE      10      // 0.10 °C
+#define DEADBAND_HUMIDITY         50      // 0.50 %RH
+#define DEADBAND_PRESSURE         10      // 10 Pa = 0.10 hPa
+#define DEADBAND_HEARTBEAT_MS     60000   // Report at least once a minute
+
+typedef struct {
+    bool enabled;            // Off = every sample is reported
+    uint16_t temperature;    // 0.01 °C
+    uint16_t humidity;       // 0.01 %RH
+    uint32_t pressure;       // Pa
+    uint32_t heartbeatMs;    // Longest time without a report
+} DeadbandSettings;
+
+class DeadbandFilter {
+private:
+    DeadbandSettings settings;
+    BufferedSample lastReported;
+    bool haveReported;
+
+    static uint32_t distance(int32_t a, int32_t b) { return (uint32_t)(a > b ? a - b : b - a); }
+
+public:
+    // Statistics
+    uint32_t seen = 0;
+    uint32_t reported = 0;
+    uint32_t heartbeats = 0;  // Reports that happened only because of the heartbeat
+
+    DeadbandFilter() : haveReported(false) {
+        settings.enabled = true;
+        settings.temperature = DEADBAND_TEMPERATURE;
+        settings.humidity = DEADBAND_HUMIDITY;
+        settings.pressure = DEADBAND_PRESSURE;
+        settings.heartbeatMs = DEADBAND_HEARTBEAT_MS;
+    }
+
+    void setSettings(const DeadbandSettings &s) { settings = s; }
+    const DeadbandSettings &getSettings() const { return settings; }
+
+    // Forget the last report, so the next sample always goes out (e.g. after
+    // the thresholds changed)
+    void reset() { haveReported = false; }
+
+    // Should this sample be published? Remembers it as the new reference if so
+    bool shouldReport(const BufferedSample &sample) {
+        seen++;
+
+        bool report = !settings.enabled || !haveReported;
+        if (!report) {
+            report = distance(sample.temperature, lastReported.temperature) > settings.temperature ||
+                     distance(sample.humidity, lastReported.humidity) > settings.humidity ||
+                     distance((int32_t)sample.pressure, (int32_t)lastReported.pressure) > settings.pressure;
+            if (!report && sample.timestamp - lastReported.timestamp >= settings.heartbeatMs) {
+                report = true;
+                heartbeats++;
+            }
+        }
+
+        if (report) {
+            lastReported = sample;
+            haveReported = true;
+            reported++;
+        }
+        return report;
+    }
+};
+
+#endif // DEADBAND_FILTER_H
@@ -0,0 +1,169 @@
+#ifndef DISPLAY_WIDGETS_H
+#define DISPLAY_WIDGETS_H
+
+// Retained-mode text widgets for the display
+//
+// updateDisplay() used to wipe a whole band of the screen (fillRect with
+// the background) and then print every label and value again. That sends
+// 240 x 110 pixels x 2 bytes = 52.8 KB over SPI every refresh, and you can
+// see the text flicker, even though usually only a digit or two changed.
+//
+// Now each piece of text on the screen is a TextWidget that remembers what
+// it's currently showing. set() only records the new text; the renderer
+// then compares it with the old one, character by character, and redraws
+// just the character cells that are different (a GLCD character with a
+// background color paints its whole 6 x 8 cell, so no clearing is needed).
+// If the new text is shorter, the leftover cells are cleared with one
+// fillRect. Labels that never change cost nothing after the first frame.
+//
+// The renderer is a template on the graphics class, so the same code
+// drives TFT_eSPI on the ESP32 and a pixel-counting fake in the native
+// benchmarks. It only needs drawChar(x, y, c, color, bg, size) and
+// fillRect(x, y, w, h, color). It counts what each frame sends to the panel,
+// so the savings can be measured.
+
+#include <stdint.h>
+#include <string.h>
+
+#define WIDGET_MAX_CHARS   24   // Longest text one widget can show
+#define WIDGET_CHAR_WIDTH  6    // GLCD font cell at text size 1 (5 x 7 glyph plus spacing)
+#define WIDGET_CHAR_HEIGHT 8
+
+// What one frame (or all frames, added up) sent to the display
+typedef struct {
+    uint32_t frames;
+    uint32_t glyphs;      // Character cells drawn
+    uint32_t fills;       // Rectangles cleared behind text that got shorter
+    uint32_t pixels;      // Pixels written
+    uint32_t bytes;       // Pixel data over SPI (2 bytes per pixel in RGB565)
+    uint32_t drawUs;      // Time spent in the drawing calls
+} FrameStats;
+
+class TextWidget {
+private:
+    int16_t x, y;
+    uint8_t size;                          // Text size (1 = 6 x 8 pixels per character)
+    char shown[WIDGET_MAX_CHARS + 1];      // What's on the screen right now
+    uint16_t shownColor;
+    char wanted[WIDGET_MAX_CHARS + 1];     // What set() asked for
+    uint16_t wantedColor;
+
+    template <typename Gfx> friend class WidgetRenderer;
+
+public:
+    TextWidget() : x(0), y(0), size(1), shownColor(0), wantedColor(0) {
+        shown[0] = '\0';
+        wanted[0] = '\0';
+    }
+
+    void place(int16_t left, int16_t top, uint8_t textSize = 1) {
+        x = left;
+        y = top;
+        size = textSize;
+    }
+
+    // Text longer than WIDGET_MAX_CHARS is cut off
+    void set(const char *text, uint16_t color) {
+        size_t length = 0;
+        while (length < WIDGET_MAX_CHARS && text[length] != '\0') {
+            wanted[length] = text[length];
+            length++;
+        }
+        wanted[length] = '\0';
+        wantedColor = color;
+    }
+
+    // The screen under the widget was cleared (fillScreen), so it's showing
+    // nothing now - the next frame draws all of it again
+    void cleared() { shown[0] = '\0'; }
+
+    bool changed() const { return shownColor != wantedColor || strcmp(shown, wanted) != 0; }
+};
+
+template <typename Gfx>
+class WidgetRenderer {
+private:
+    Gfx &gfx;
+    uint16_t background;
+    uint32_t (*clock)();     // Microseconds, like micros()
+
+    void drawWidget(TextWidget &widget, FrameStats &frame) {
+        const uint32_t cellWidth = WIDGET_CHAR_WIDTH * widget.size;
+        const uint32_t cellHeight = WIDGET_CHAR_HEIGHT * widget.size;
+        size_t oldLength = strlen(widget.shown);
+        size_t newLength = strlen(widget.wanted);
+        bool recolor = widget.shownColor != widget.wantedColor;
+
+        // Cells past the end count as spaces: a space on the background
+        // looks exactly like an empty cell
+        for (size_t i = 0; i < newLength; i++) {
+            char before = i < oldLength ? widget.shown[i] : ' ';
+            char after = widget.wanted[i];
+            if (before == after && !(recolor && after != ' ')) {
+                continue;
+            }
+            gfx.drawChar(widget.x + (int32_t)(i * cellWidth), widget.y, (uint16_t)(uint8_t)after,
+                         widget.wantedColor, background, widget.size);
+            frame.glyphs++;
+            frame.pixels += cellWidth * cellHeight;
+        }
+
+        // The text got shorter: clear what's left of the old one in one go
+        if (oldLength > newLength) {
+            uint32_t clearWidth = (uint32_t)(oldLength - newLength) * cellWidth;
+            gfx.fillRect(widget.x + (int32_t)(newLength * cellWidth), widget.y, clearWidth, cellHeight, background);
+            frame.fills++;
+            frame.pixels += clearWidth * cellHeight;
+        }
+
+        memcpy(widget.shown, widget.wanted, newLength + 1);
+        widget.shownColor = widget.wantedColor;
+    }
+
+public:
+    FrameStats lastFrame;    // The most recent render()
+    FrameStats total;        // Everything since the last resetStats()
+
+    WidgetRenderer(Gfx &target, uint16_t backgroundColor, uint32_t (*clockUs)())
+        : gfx(target), background(backgroundColor), clock(clockUs) {
+        memset(&lastFrame, 0, sizeof(lastFrame));
+        resetStats();
+    }
+
+    // Draw one frame: whatever changed in these widgets since the last one
+    void render(TextWidget *widgets, uint8_t count) {
+        FrameStats frame;
+        memset(&frame, 0, sizeof(frame));
+        uint32_t start = clock();
+        for (uint8_t i = 0; i < count; i++) {
+            if (widgets[i].changed()) {
+                drawWidget(widgets[i], frame);
+            }
+        }
+        frame.drawUs = clock() - start;
+        frame.frames = 1;
+        frame.bytes = frame.pixels * 2;
+
+        lastFrame = frame;
+        total.frames++;
+        total.glyphs += frame.glyphs;
+        total.fills += frame.fills;
+        total.pixels += frame.pixels;
+        total.bytes += frame.bytes;
+        total.drawUs += frame.drawUs;
+    }
+
+    // Would render() draw anything? Lets the caller skip getting the bus ready
+    static bool hasWork(const TextWidget *widgets, uint8_t count) {
+        for (uint8_t i = 0; i < count; i++) {
+            if (widgets[i].changed()) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void resetStats() { memset(&total, 0, sizeof(total)); }
+};
+
+#endif // DISPLAY_WIDGETS_H
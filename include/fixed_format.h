@@ -0,0 +1,169 @@
+#ifndef FIXED_FORMAT_H
+#define FIXED_FORMAT_H
+
+// Fast fixed-point decimal formatting
+//
+// The sensor values come out of the compensation code as exact integers, and
+// bme280ToFixed() turns them into hundredths (0.01 °C, 0.01 hPa, 0.01 %RH).
+// Printing those with "%.2f" meant converting to float first and then going
+// through newlib's float printf, which is slow on the ESP32 and drags a lot of
+// code into the firmware. A value in hundredths is just "whole part, dot, two
+// digits", so these helpers do exactly that with integer math only.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+// Write an unsigned integer in decimal, returns the number of characters
+// (no terminating NUL - the callers below add it)
+inline size_t formatUInt(char *out, uint32_t value) {
+    char digits[10];  // 4294967295 is the longest
+    size_t count = 0;
+    do {
+        digits[count++] = (char)('0' + value % 10);  // Divide by a constant = multiply, it's cheap
+        value /= 10;
+    } while (value != 0);
+
+    for (size_t i = 0; i < count; i++) {
+        out[i] = digits[count - 1 - i];
+    }
+    return count;
+}
+
+// Write a value given in hundredths with 0, 1 or 2 decimal places
+// Fewer places round half away from zero (1.25 -> "1.3"), and a value that
+// rounds to zero never gets a minus sign. Returns the number of characters
+inline size_t formatCenti(char *out, int32_t centi, uint8_t decimals = 2) {
+    uint32_t magnitude = (centi < 0) ? 0u - (uint32_t)centi : (uint32_t)centi;
+    uint32_t scale = 100;
+    if (decimals == 1) {
+        magnitude = (magnitude + 5) / 10;
+        scale = 10;
+    } else if (decimals == 0) {
+        magnitude = (magnitude + 50) / 100;
+        scale = 1;
+    }
+
+    char *p = out;
+    if (centi < 0 && magnitude != 0) {
+        *p++ = '-';
+    }
+    p += formatUInt(p, magnitude / scale);
+
+    if (scale > 1) {
+        uint32_t fraction = magnitude % scale;
+        *p++ = '.';
+        if (scale == 100) {
+            *p++ = (char)('0' + fraction / 10);
+            fraction %= 10;
+        }
+        *p++ = (char)('0' + fraction);
+    }
+    return (size_t)(p - out);
+}
+
+// The other direction, for commands: parse "23", "-1.5" or "0.25" into
+// hundredths (extra decimals are cut off). Returns a pointer just past the
+// number, or nullptr if there's no number or it's too big
+inline const char *parseCenti(const char *text, int32_t &centi) {
+    const char *p = text;
+    bool negative = (*p == '-');
+    if (negative || *p == '+') {
+        p++;
+    }
+
+    uint32_t whole = 0;
+    int digits = 0;
+    while (*p >= '0' && *p <= '9') {
+        whole = whole * 10 + (uint32_t)(*p++ - '0');
+        if (whole > 20000000) {
+            return nullptr;  // Way past anything a sensor setting needs
+        }
+        digits++;
+    }
+
+    uint32_t fraction = 0;
+    if (*p == '.') {
+        p++;
+        for (int place = 0; *p >= '0' && *p <= '9'; place++, p++) {
+            if (place < 2) {
+                fraction += (uint32_t)(*p - '0') * (place == 0 ? 10 : 1);
+            }
+            digits++;
+        }
+    }
+    if (digits == 0) {
+        return nullptr;
+    }
+
+    int32_t value = (int32_t)(whole * 100 + fraction);
+    centi = negative ? -value : value;
+    return p;
+}
+
+// Parse a plain unsigned integer ("500"), for arguments that are counts or
+// milliseconds. Same contract as parseCenti(): end pointer, or nullptr if
+// there's no number or it doesn't fit in 32 bits
+inline const char *parseUInt(const char *text, uint32_t &value) {
+    const char *p = text;
+    uint32_t result = 0;
+    while (*p >= '0' && *p <= '9') {
+        uint32_t digit = (uint32_t)(*p++ - '0');
+        if (result > (UINT32_MAX - digit) / 10) {
+            return nullptr;
+        }
+        result = result * 10 + digit;
+    }
+    if (p == text) {
+        return nullptr;
+    }
+    value = result;
+    return p;
+}
+
+// A small bounded string builder for MQTT payloads and display text
+// It never writes past the end: an append that doesn't fit is dropped and
+// overflowed() turns true, so the caller can tell the message got cut short
+class TextBuffer {
+private:
+    char *buffer;
+    size_t size;
+    size_t length;
+    bool overflow;
+
+    TextBuffer &append(const char *text, size_t count) {
+        if (overflow || length + count >= size) {
+            overflow = true;
+            return *this;
+        }
+        memcpy(buffer + length, text, count);
+        length += count;
+        buffer[length] = '\0';
+        return *this;
+    }
+
+public:
+    TextBuffer(char *buf, size_t bufSize) : buffer(buf), size(bufSize), length(0), overflow(bufSize == 0) {
+        if (bufSize > 0) {
+            buffer[0] = '\0';
+        }
+    }
+
+    TextBuffer &add(const char *text) { return append(text, strlen(text)); }
+
+    TextBuffer &addUInt(uint32_t value) {
+        char digits[10];
+        return append(digits, formatUInt(digits, value));
+    }
+
+    TextBuffer &addCenti(int32_t centi, uint8_t decimals = 2) {
+        char digits[16];
+        return append(digits, formatCenti(digits, centi, decimals));
+    }
+
+    const char *c_str() const { return buffer; }
+    size_t len() const { return length; }
+    bool overflowed() const { return overflow; }
+};
+
+#endif // FIXED_FORMAT_H
@@ -0,0 +1,685 @@
+#ifndef FRAME_EXPORT_H
+#define FRAME_EXPORT_H
+
+// Saving the simulated display's frames (native builds only)
+//
+// The first version wrote ASCII PPM ("P3"): three numbers as text per pixel,
+// pushed through an ofstream one at a time. For a 240 x 240 screen that's
+// ~700 KB and 172,800 int-to-text conversions per frame. Now:
+//
+// - encodeP6(): binary PPM, 3 bytes per pixel after a short header, built in
+//   memory and written with a single write (173 KB)
+// - encodePng(): a PNG any viewer can open, with no zlib needed - the image
+//   data goes into one fixed-Huffman deflate block whose only matches are
+//   "same as a pixel just to the left" and "same as the pixel above", which
+//   is most of a UI screen (a few KB instead of P6's 173 KB). decodePng() reads
+//   these back with a small inflater (the golden images for the display
+//   tests are stored this way)
+// - FrameRecorder: for long soak runs, keeps every Nth frame in one sequence
+//   file. Each frame only stores the runs of pixels that changed since the
+//   previous recorded frame, and our screen barely changes from one refresh
+//   to the next, so a recorded frame is usually a few hundred bytes instead
+//   of 115 KB. FrameSequenceReader plays it back
+//
+// RGB565 goes to RGB888 as value * 255 / max, the same as before.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+inline void rgb565ToRgb888(uint16_t pixel, uint8_t *out) {
+    out[0] = (uint8_t)(((pixel >> 11) & 0x1F) * 255 / 31);
+    out[1] = (uint8_t)(((pixel >> 5) & 0x3F) * 255 / 63);
+    out[2] = (uint8_t)((pixel & 0x1F) * 255 / 31);
+}
+
+// Write a whole buffer to a file in one go. Returns false if it couldn't
+inline bool writeFile(const std::string &filename, const std::vector<uint8_t> &data) {
+    FILE *file = fopen(filename.c_str(), "wb");
+    if (!file) {
+        return false;
+    }
+    bool ok = fwrite(data.data(), 1, data.size(), file) == data.size();
+    return (fclose(file) == 0) && ok;
+}
+
+// Read a whole file. Returns false if it couldn't
+inline bool readFile(const std::string &filename, std::vector<uint8_t> &data) {
+    FILE *file = fopen(filename.c_str(), "rb");
+    if (!file) {
+        return false;
+    }
+    data.clear();
+    uint8_t chunk[4096];
+    size_t got;
+    while ((got = fread(chunk, 1, sizeof(chunk), file)) > 0) {
+        data.insert(data.end(), chunk, chunk + got);
+    }
+    bool ok = !ferror(file);
+    fclose(file);
+    return ok;
+}
+
+inline void encodeP6(const uint16_t *pixels, int width, int height, std::vector<uint8_t> &out) {
+    char header[32];
+    int headerLength = snprintf(header, sizeof(header), "P6\n%d %d\n255\n", width, height);
+    out.resize((size_t)headerLength + (size_t)width * height * 3);
+    memcpy(out.data(), header, (size_t)headerLength);
+    uint8_t *rgb = out.data() + headerLength;
+    for (int i = 0; i < width * height; i++, rgb += 3) {
+        rgb565ToRgb888(pixels[i], rgb);
+    }
+}
+
+// --- PNG ---
+
+// CRC-32 as PNG uses it (the table is built on first use)
+inline uint32_t pngCrc(const uint8_t *data, size_t length, uint32_t crc = 0) {
+    static uint32_t table[256];
+    static bool ready = false;
+    if (!ready) {
+        for (uint32_t n = 0; n < 256; n++) {
+            uint32_t c = n;
+            for (int k = 0; k < 8; k++) {
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            }
+            table[n] = c;
+        }
+        ready = true;
+    }
+    crc = ~crc;
+    for (size_t i = 0; i < length; i++) {
+        crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+inline void putBigEndian32(std::vector<uint8_t> &out, uint32_t value) {
+    out.push_back((uint8_t)(value >> 24));
+    out.push_back((uint8_t)(value >> 16));
+    out.push_back((uint8_t)(value >> 8));
+    out.push_back((uint8_t)value);
+}
+
+// A chunk is length, type, data, CRC over type and data
+inline void putPngChunk(std::vector<uint8_t> &out, const char *type, const uint8_t *data, size_t length) {
+    putBigEndian32(out, (uint32_t)length);
+    size_t start = out.size();
+    out.insert(out.end(), type, type + 4);
+    out.insert(out.end(), data, data + length);
+    putBigEndian32(out, pngCrc(&out[start], length + 4));
+}
+
+// Adler-32, taking the modulo only every 5552 bytes (the most that can be
+// added up before b could overflow 32 bits)
+inline uint32_t adler32(const uint8_t *data, size_t length) {
+    uint32_t a = 1, b = 0;
+    for (size_t i = 0; i < length;) {
+        size_t end = length - i < 5552 ? length : i + 5552;
+        for (; i < end; i++) {
+            a += data[i];
+            b += a;
+        }
+        a %= 65521;
+        b %= 65521;
+    }
+    return (b << 16) | a;
+}
+
+// Deflate's length and distance codes: the smallest value of each code and
+// how many extra bits follow it (RFC 1951, 3.2.5)
+static const uint16_t deflateLengthBase[29] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+                                               35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+static const uint8_t deflateLengthExtra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+                                               3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+static const uint16_t deflateDistanceBase[30] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+                                                 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145,
+                                                 8193, 12289, 16385, 24577};
+static const uint8_t deflateDistanceExtra[30] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+                                                 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+// Deflate packs bits starting from the lowest bit of each byte. Extra bits
+// go in as they are, Huffman codes with their first bit first
+class DeflateBitWriter {
+private:
+    std::vector<uint8_t> &out;
+    uint32_t bits;
+    int count;
+
+public:
+    explicit DeflateBitWriter(std::vector<uint8_t> &target) : out(target), bits(0), count(0) {}
+
+    void put(uint32_t value, int length) {
+        bits |= value << count;
+        count += length;
+        while (count >= 8) {
+            out.push_back((uint8_t)bits);
+            bits >>= 8;
+            count -= 8;
+        }
+    }
+    void putCode(uint32_t code, int length) {
+        uint32_t reversed = 0;
+        for (int i = 0; i < length; i++) {
+            reversed |= ((code >> i) & 1) << (length - 1 - i);
+        }
+        put(reversed, length);
+    }
+    // A literal/length symbol in the fixed Huffman code
+    void putSymbol(uint16_t symbol) {
+        if (symbol < 144) {
+            putCode(0x30 + symbol, 8);
+        } else if (symbol < 256) {
+            putCode(0x190 + symbol - 144, 9);
+        } else if (symbol < 280) {
+            putCode(symbol - 256, 7);
+        } else {
+            putCode(0xC0 + symbol - 280, 8);
+        }
+    }
+    // "Copy 'length' bytes from 'distance' back" (3..258, 1..32768)
+    void putMatch(size_t length, size_t distance) {
+        int code = 28;
+        while (deflateLengthBase[code] > length) {
+            code--;
+        }
+        putSymbol((uint16_t)(257 + code));
+        put((uint32_t)(length - deflateLengthBase[code]), deflateLengthExtra[code]);
+        code = 29;
+        while (deflateDistanceBase[code] > distance) {
+            code--;
+        }
+        putCode((uint32_t)code, 5);
+        put((uint32_t)(distance - deflateDistanceBase[code]), deflateDistanceExtra[code]);
+    }
+    void flush() {
+        if (count > 0) {
+            out.push_back((uint8_t)bits);
+            bits = 0;
+            count = 0;
+        }
+    }
+};
+
+// One fixed-Huffman deflate block. A real compressor searches the whole
+// window for matches; ours only tries a few places: the previous six pixels
+// (so runs of background between the strokes of a glyph match too) and the
+// same spot one and two rows up. On a screen of flat colors and text that's
+// nearly all of it, and it needs no hash table
+inline void deflateFixed(const std::vector<uint8_t> &raw, size_t rowBytes, std::vector<uint8_t> &out) {
+    DeflateBitWriter w(out);
+    w.put(1, 1);  // BFINAL
+    w.put(1, 2);  // BTYPE = 01 (fixed Huffman)
+    const size_t size = raw.size();
+    const size_t distances[8] = {3, 6, 9, 12, 15, 18, rowBytes, 2 * rowBytes};
+    size_t i = 0;
+    while (i < size) {
+        size_t limit = size - i < 258 ? size - i : 258;
+        size_t bestLength = 0, bestDistance = 0;
+        for (size_t distance : distances) {
+            if (distance > i || distance > 32768) {
+                continue;
+            }
+            size_t length = 0;
+            while (length < limit && raw[i + length] == raw[i + length - distance]) {
+                length++;
+            }
+            if (length > bestLength) {
+                bestLength = length;
+                bestDistance = distance;
+            }
+        }
+        if (bestLength >= 3) {
+            w.putMatch(bestLength, bestDistance);
+            i += bestLength;
+        } else {
+            w.putSymbol(raw[i++]);
+        }
+    }
+    w.putSymbol(256);  // End of block
+    w.flush();
+}
+
+inline void encodePng(const uint16_t *pixels, int width, int height, std::vector<uint8_t> &out) {
+    // The raw image: every row starts with filter type 0 (none)
+    const size_t rowBytes = (size_t)width * 3 + 1;
+    std::vector<uint8_t> raw(rowBytes * height);
+    for (int y = 0; y < height; y++) {
+        uint8_t *row = &raw[y * rowBytes];
+        row[0] = 0;
+        for (int x = 0; x < width; x++) {
+            rgb565ToRgb888(pixels[y * width + x], row + 1 + x * 3);
+        }
+    }
+
+    // zlib stream: header, one fixed-Huffman block, Adler-32
+    std::vector<uint8_t> zlib;
+    zlib.push_back(0x78);  // Deflate, 32 KB window
+    zlib.push_back(0x01);  // No preset dictionary, check bits so that 0x7801 % 31 == 0
+    deflateFixed(raw, rowBytes, zlib);
+    putBigEndian32(zlib, adler32(raw.data(), raw.size()));
+
+    static const uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    uint8_t header[13];
+    header[0] = (uint8_t)(width >> 24);
+    header[1] = (uint8_t)(width >> 16);
+    header[2] = (uint8_t)(width >> 8);
+    header[3] = (uint8_t)width;
+    header[4] = (uint8_t)(height >> 24);
+    header[5] = (uint8_t)(height >> 16);
+    header[6] = (uint8_t)(height >> 8);
+    header[7] = (uint8_t)height;
+    header[8] = 8;   // Bits per channel
+    header[9] = 2;   // Truecolor RGB
+    header[10] = 0;  // Deflate
+    header[11] = 0;  // Adaptive filtering (we use "none" on every row)
+    header[12] = 0;  // Not interlaced
+
+    out.clear();
+    out.reserve(zlib.size() + 64);
+    out.insert(out.end(), signature, signature + 8);
+    putPngChunk(out, "IHDR", header, sizeof(header));
+    putPngChunk(out, "IDAT", zlib.data(), zlib.size());
+    putPngChunk(out, "IEND", nullptr, 0);
+}
+
+inline uint32_t readBigEndian32(const uint8_t *p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+// Bounded bit reader for inflating - reading past the end sets 'bad'
+class DeflateBitReader {
+private:
+    const uint8_t *data;
+    size_t size;
+    size_t pos;
+    uint32_t bits;
+    int count;
+
+public:
+    bool bad;
+
+    DeflateBitReader(const uint8_t *d, size_t n) : data(d), size(n), pos(0), bits(0), count(0), bad(false) {}
+
+    uint32_t get(int length) {
+        while (count < length) {
+            if (pos >= size) {
+                bad = true;
+                return 0;
+            }
+            bits |= (uint32_t)data[pos++] << count;
+            count += 8;
+        }
+        uint32_t value = bits & ((1u << length) - 1);
+        bits >>= length;
+        count -= length;
+        return value;
+    }
+    // A Huffman code, first bit first
+    uint32_t getCode(int length) {
+        uint32_t code = 0;
+        for (int i = 0; i < length; i++) {
+            code = (code << 1) | get(1);
+        }
+        return code;
+    }
+    // A literal/length symbol in the fixed Huffman code (-1 if broken)
+    int symbol() {
+        uint32_t code = getCode(7);
+        if (code <= 0x17) {
+            return 256 + (int)code;
+        }
+        code = (code << 1) | get(1);
+        if (code >= 0x30 && code <= 0xBF) {
+            return (int)code - 0x30;
+        }
+        if (code >= 0xC0 && code <= 0xC7) {
+            return 280 + (int)code - 0xC0;
+        }
+        code = (code << 1) | get(1);
+        if (code >= 0x190 && code <= 0x1FF) {
+            return 144 + (int)code - 0x190;
+        }
+        bad = true;
+        return -1;
+    }
+    void alignToByte() { get(count % 8); }
+    bool atEnd() const { return pos == size && count == 0; }
+};
+
+// Inflate a zlib stream of stored and fixed-Huffman blocks - what
+// encodePng() writes now, and the stored blocks it used to write. Dynamic
+// Huffman blocks (what zlib itself mostly writes) aren't supported. Stops
+// with false rather than produce more than 'expected' bytes
+inline bool inflateZlib(const std::vector<uint8_t> &zlib, size_t expected, std::vector<uint8_t> &raw) {
+    if (zlib.size() < 6 || (zlib[0] & 0x0F) != 8 || (zlib[1] & 0x20) != 0 || ((zlib[0] << 8) | zlib[1]) % 31 != 0) {
+        return false;
+    }
+    DeflateBitReader r(zlib.data() + 2, zlib.size() - 2);
+    raw.clear();
+    raw.reserve(expected);
+    bool last = false;
+    while (!last) {
+        last = r.get(1) != 0;
+        uint32_t type = r.get(2);
+        if (type == 0) {
+            r.alignToByte();
+            uint32_t length = r.get(16);
+            uint32_t inverse = r.get(16);
+            if (r.bad || (length ^ 0xFFFF) != inverse || raw.size() + length > expected) {
+                return false;
+            }
+            for (uint32_t i = 0; i < length && !r.bad; i++) {
+                raw.push_back((uint8_t)r.get(8));
+            }
+        } else if (type == 1) {
+            for (;;) {
+                int symbol = r.symbol();
+                if (r.bad) {
+                    return false;
+                }
+                if (symbol < 256) {
+                    if (raw.size() >= expected) {
+                        return false;
+                    }
+                    raw.push_back((uint8_t)symbol);
+                    continue;
+                }
+                if (symbol == 256) {
+                    break;
+                }
+                int code = symbol - 257;
+                if (code >= 29) {
+                    return false;
+                }
+                size_t length = deflateLengthBase[code] + r.get(deflateLengthExtra[code]);
+                code = (int)r.getCode(5);
+                if (code >= 30) {
+                    return false;
+                }
+                size_t distance = deflateDistanceBase[code] + r.get(deflateDistanceExtra[code]);
+                if (r.bad || distance > raw.size() || raw.size() + length > expected) {
+                    return false;
+                }
+                for (size_t i = 0; i < length; i++) {
+                    uint8_t byte = raw[raw.size() - distance];  // May overlap what we're copying
+                    raw.push_back(byte);
+                }
+            }
+        } else {
+            return false;
+        }
+        if (r.bad) {
+            return false;
+        }
+    }
+    r.alignToByte();
+    uint32_t check = 0;  // Adler-32, big-endian
+    for (int i = 0; i < 4; i++) {
+        check = (check << 8) | r.get(8);
+    }
+    return !r.bad && r.atEnd() && raw.size() == expected && check == adler32(raw.data(), raw.size());
+}
+
+// Read back a PNG written by encodePng() (8-bit RGB, no filtering). Checks
+// every CRC and the Adler-32 on the way, and returns false for anything else.
+// The pixels come out as RGB888, row after row
+inline bool decodePng(const std::vector<uint8_t> &png, int &width, int &height, std::vector<uint8_t> &rgb) {
+    static const uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    if (png.size() < 8 || memcmp(png.data(), signature, 8) != 0) {
+        return false;
+    }
+    std::vector<uint8_t> zlib;
+    bool sawHeader = false, sawEnd = false;
+    size_t at = 8;
+    while (at + 12 <= png.size() && !sawEnd) {
+        uint32_t length = readBigEndian32(&png[at]);
+        if (length > png.size() - at - 12 ||
+            pngCrc(&png[at + 4], length + 4) != readBigEndian32(&png[at + 8 + length])) {
+            return false;
+        }
+        const uint8_t *type = &png[at + 4];
+        const uint8_t *data = &png[at + 8];
+        if (memcmp(type, "IHDR", 4) == 0) {
+            width = (int)readBigEndian32(data);
+            height = (int)readBigEndian32(data + 4);
+            sawHeader = length == 13 && width > 0 && height > 0 && width <= 4096 && height <= 4096 &&
+                        data[8] == 8 && data[9] == 2 && data[12] == 0;
+        } else if (memcmp(type, "IDAT", 4) == 0) {
+            zlib.insert(zlib.end(), data, data + length);
+        } else if (memcmp(type, "IEND", 4) == 0) {
+            sawEnd = true;
+        }
+        at += 12 + length;
+    }
+    const size_t rowBytes = (size_t)width * 3 + 1;
+    std::vector<uint8_t> raw;
+    if (!sawHeader || !sawEnd || !inflateZlib(zlib, rowBytes * height, raw)) {
+        return false;
+    }
+
+    rgb.clear();
+    rgb.reserve((size_t)width * height * 3);
+    for (int y = 0; y < height; y++) {
+        const uint8_t *row = &raw[y * rowBytes];
+        if (row[0] != 0) {
+            return false;
+        }
+        rgb.insert(rgb.end(), row + 1, row + rowBytes);
+    }
+    return true;
+}
+
+// --- Frame sequences ---
+//
+// File layout (all numbers little-endian):
+//   "FSEQ" version(u8 = 1) width(u16) height(u16) everyN(u16)
+//   then per recorded frame:
+//     frame number (u32), run count (u32), and per run:
+//       skip (u32): unchanged pixels before the run, length (u16), the pixels (u16 each)
+// The first recorded frame is stored against an all-black screen.
+
+#define FRAME_SEQUENCE_MAGIC   "FSEQ"
+#define FRAME_SEQUENCE_VERSION 1
+
+class FrameRecorder {
+private:
+    FILE *file;
+    int width;
+    int height;
+    uint32_t everyN;
+    uint32_t frameNumber;
+    std::vector<uint16_t> previous;   // The last recorded frame
+    std::vector<uint8_t> record;      // One frame's record, written in one go
+
+    void put16(uint16_t value) {
+        record.push_back((uint8_t)value);
+        record.push_back((uint8_t)(value >> 8));
+    }
+    void put32(uint32_t value) {
+        put16((uint16_t)value);
+        put16((uint16_t)(value >> 16));
+    }
+
+public:
+    // Statistics
+    uint32_t framesRecorded = 0;
+    uint64_t bytesWritten = 0;
+
+    FrameRecorder() : file(nullptr), width(0), height(0), everyN(1), frameNumber(0) {}
+    ~FrameRecorder() { close(); }
+
+    // The header has 16 bits for each of these, so anything bigger is refused
+    bool open(const std::string &filename, int frameWidth, int frameHeight, uint32_t recordEvery) {
+        close();
+        if (frameWidth <= 0 || frameWidth > 0xFFFF || frameHeight <= 0 || frameHeight > 0xFFFF ||
+            recordEvery > 0xFFFF) {
+            return false;
+        }
+        file = fopen(filename.c_str(), "wb");
+        if (!file) {
+            return false;
+        }
+        width = frameWidth;
+        height = frameHeight;
+        everyN = recordEvery ? recordEvery : 1;
+        frameNumber = 0;
+        framesRecorded = 0;
+        previous.assign((size_t)width * height, 0);
+        record.clear();
+        record.insert(record.end(), FRAME_SEQUENCE_MAGIC, FRAME_SEQUENCE_MAGIC + 4);
+        record.push_back(FRAME_SEQUENCE_VERSION);
+        put16((uint16_t)width);
+        put16((uint16_t)height);
+        put16((uint16_t)everyN);
+        bytesWritten = fwrite(record.data(), 1, record.size(), file);
+        return bytesWritten == record.size();
+    }
+
+    bool isOpen() const { return file != nullptr; }
+
+    // Call once per displayed frame; only every Nth is written
+    void frame(const uint16_t *pixels) {
+        if (!file) {
+            return;
+        }
+        uint32_t number = frameNumber++;
+        if (number % everyN != 0) {
+            return;
+        }
+
+        record.clear();
+        put32(number);
+        put32(0);  // Run count, filled in below
+        uint32_t runs = 0;
+        const size_t count = previous.size();
+        size_t i = 0, lastEnd = 0;
+        while (i < count) {
+            if (pixels[i] == previous[i]) {
+                i++;
+                continue;
+            }
+            // A run of changed pixels. Short unchanged gaps are cheaper to
+            // send than to end the run (a new run costs 6 bytes)
+            size_t start = i;
+            size_t end = i;
+            while (end < count && end - start < 65535) {
+                if (pixels[end] != previous[end]) {
+                    end++;
+                    continue;
+                }
+                size_t gap = end;
+                while (gap < count && gap - end < 3 && pixels[gap] == previous[gap]) {
+                    gap++;
+                }
+                if (gap - end >= 3 || gap == count || gap - start > 65535) {
+                    break;
+                }
+                end = gap;
+            }
+            put32((uint32_t)(start - lastEnd));
+            put16((uint16_t)(end - start));
+            for (size_t p = start; p < end; p++) {
+                put16(pixels[p]);
+                previous[p] = pixels[p];
+            }
+            runs++;
+            lastEnd = end;
+            i = end;
+        }
+        record[4] = (uint8_t)runs;
+        record[5] = (uint8_t)(runs >> 8);
+        record[6] = (uint8_t)(runs >> 16);
+        record[7] = (uint8_t)(runs >> 24);
+        bytesWritten += fwrite(record.data(), 1, record.size(), file);
+        framesRecorded++;
+    }
+
+    void close() {
+        if (file) {
+            fclose(file);
+            file = nullptr;
+        }
+    }
+};
+
+class FrameSequenceReader {
+private:
+    FILE *file;
+    std::vector<uint16_t> pixels;
+
+    bool read16(uint16_t &value) {
+        uint8_t bytes[2];
+        if (fread(bytes, 1, 2, file) != 2) {
+            return false;
+        }
+        value = (uint16_t)(bytes[0] | (bytes[1] << 8));
+        return true;
+    }
+    bool read32(uint32_t &value) {
+        uint16_t low, high;
+        if (!read16(low) || !read16(high)) {
+            return false;
+        }
+        value = low | ((uint32_t)high << 16);
+        return true;
+    }
+
+public:
+    int width = 0;
+    int height = 0;
+    uint32_t everyN = 0;
+    uint32_t frameNumber = 0;   // Of the frame last read
+
+    FrameSequenceReader() : file(nullptr) {}
+    ~FrameSequenceReader() {
+        if (file) {
+            fclose(file);
+        }
+    }
+
+    bool open(const std::string &filename) {
+        file = fopen(filename.c_str(), "rb");
+        char magic[4];
+        uint8_t version;
+        uint16_t w, h, n;
+        if (!file || fread(magic, 1, 4, file) != 4 || memcmp(magic, FRAME_SEQUENCE_MAGIC, 4) != 0 ||
+            fread(&version, 1, 1, file) != 1 || version != FRAME_SEQUENCE_VERSION ||
+            !read16(w) || !read16(h) || !read16(n)) {
+            return false;
+        }
+        width = w;
+        height = h;
+        everyN = n;
+        pixels.assign((size_t)width * height, 0);
+        return true;
+    }
+
+    // The next recorded frame, or nullptr at the end (or if the file is broken)
+    const uint16_t *next() {
+        uint32_t runs;
+        if (!file || !read32(frameNumber) || !read32(runs)) {
+            return nullptr;
+        }
+        size_t position = 0;
+        for (uint32_t r = 0; r < runs; r++) {
+            uint32_t skip;
+            uint16_t length;
+            if (!read32(skip) || !read16(length) || position + skip + length > pixels.size()) {
+                return nullptr;
+            }
+            position += skip;
+            for (uint16_t p = 0; p < length; p++) {
+                if (!read16(pixels[position++])) {
+                    return nullptr;
+                }
+            }
+        }
+        return pixels.data();
+    }
+};
+
+#endif // FRAME_EXPORT_H
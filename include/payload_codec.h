@@ -0,0 +1,453 @@
+#ifndef PAYLOAD_CODEC_H
+#define PAYLOAD_CODEC_H
+
+// Payload formats for the batched sensor messages
+//
+// JSON is easy to read, but the broker side spends most of its CPU parsing it.
+// So a batch can also go out in one of two binary formats, selected with
+// MQTT_PAYLOAD_FORMAT in main.cpp. The device publishes to
+// "sensor/bme280/data/<format>" so subscribers know what they're getting.
+//
+// PACKED - versioned little-endian frame, fixed layout:
+//   offset  size  field
+//   0       2     magic 'B' 'M'
+//   2       1     version (1)
+//   3       1     flags (bit 0: deltas are 32-bit instead of 16-bit)
+//   4       1     bus
+//   5       1     address
+//   6       1     n (samples)
+//   7       4     now (millis when built)
+//   11      4     t0 (millis of the first sample)
+//   15      n*(2 or 4)  dt, gap to the previous sample (first one is 0)
+//   ..      n*2   temperature, int16, 0.01 °C
+//   ..      n*2   humidity, uint16, 0.01 %RH
+//   ..      n*4   pressure, uint32, Pa
+//
+// CBOR (RFC 8949) - a map with the same keys as the JSON, but every value is an
+// integer: "scale": -2 says the three measurement arrays are in hundredths
+//
+// Both come with a decoder that rebuilds absolute timestamps, so the same
+// code can be used on the receiving side (and is checked in the native bench).
+
+#include <stdint.h>
+#include <string.h>
+#include "batch_publisher.h"
+
+#define PAYLOAD_PACKED_VERSION   1
+#define PAYLOAD_FLAG_WIDE_DT     0x01
+
+// PubSubClient builds the whole packet in its buffer: 5 bytes reserved for the
+// fixed header, 2 for the topic length, the topic, then the payload. A payload
+// that doesn't fit makes publish() fail, every time, so the encoders are only
+// given what's left after the longest data topic
+#define MQTT_PACKET_BUFFER_BYTES 768   // mqttClient.setBufferSize()
+#define MQTT_PACKET_HEADER_BYTES 7     // Fixed header room + topic length
+#define MQTT_TOPIC_MAX_BYTES     32    // "sensor/bme280/data/packed" is 25
+#define PAYLOAD_MAX_BYTES        (MQTT_PACKET_BUFFER_BYTES - MQTT_PACKET_HEADER_BYTES - MQTT_TOPIC_MAX_BYTES)
+
+// The size PubSubClient needs for one publish (it fails if this is over the buffer)
+inline size_t mqttPacketBytes(size_t topicLength, size_t payloadLength) {
+    return MQTT_PACKET_HEADER_BYTES + topicLength + payloadLength;
+}
+
+typedef enum {
+    PAYLOAD_JSON = 0,
+    PAYLOAD_PACKED,
+    PAYLOAD_CBOR
+} PayloadFormat;
+
+// Topic suffix for each format
+inline const char *payloadFormatName(PayloadFormat format) {
+    switch (format) {
+        case PAYLOAD_PACKED: return "packed";
+        case PAYLOAD_CBOR:   return "cbor";
+        default:             return "json";
+    }
+}
+
+// A batch as it comes out of a decoder (absolute timestamps)
+typedef struct {
+    uint8_t bus;
+    uint8_t address;
+    uint8_t count;
+    uint32_t now;
+    BufferedSample samples[BATCH_MAX_SAMPLES];
+} DecodedBatch;
+
+// Bounded byte writer, the binary sibling of TextBuffer
+class ByteWriter {
+private:
+    uint8_t *buffer;
+    size_t size;
+    size_t length;
+    bool overflow;
+
+public:
+    ByteWriter(uint8_t *buf, size_t bufSize) : buffer(buf), size(bufSize), length(0), overflow(false) {}
+
+    void put(const void *data, size_t count) {
+        if (overflow || length + count > size) {
+            overflow = true;
+            return;
+        }
+        memcpy(buffer + length, data, count);
+        length += count;
+    }
+    void u8(uint8_t v) { put(&v, 1); }
+    void u16(uint16_t v) {
+        uint8_t b[2] = {(uint8_t)v, (uint8_t)(v >> 8)};
+        put(b, 2);
+    }
+    void u32(uint32_t v) {
+        uint8_t b[4] = {(uint8_t)v, (uint8_t)(v >> 8), (uint8_t)(v >> 16), (uint8_t)(v >> 24)};
+        put(b, 4);
+    }
+
+    // CBOR: major type in the top 3 bits, then the shortest argument encoding
+    void cborHead(uint8_t major, uint32_t value) {
+        major <<= 5;
+        if (value < 24) {
+            u8(major | (uint8_t)value);
+        } else if (value <= 0xFF) {
+            uint8_t b[2] = {(uint8_t)(major | 24), (uint8_t)value};
+            put(b, 2);
+        } else if (value <= 0xFFFF) {
+            uint8_t b[3] = {(uint8_t)(major | 25), (uint8_t)(value >> 8), (uint8_t)value};
+            put(b, 3);
+        } else {
+            uint8_t b[5] = {(uint8_t)(major | 26), (uint8_t)(value >> 24), (uint8_t)(value >> 16),
+                            (uint8_t)(value >> 8), (uint8_t)value};
+            put(b, 5);
+        }
+    }
+    void cborInt(int32_t value) {
+        if (value >= 0) {
+            cborHead(0, (uint32_t)value);
+        } else {
+            cborHead(1, (uint32_t)(-1 - value));  // Negative ints store -1 - n
+        }
+    }
+    void cborText(const char *text) {
+        size_t n = strlen(text);
+        cborHead(3, (uint32_t)n);
+        put(text, n);
+    }
+
+    size_t len() const { return length; }
+    bool overflowed() const { return overflow; }
+};
+
+// === Encoders ===
+
+inline size_t encodePacked(const SampleBatcher &batch, uint8_t bus, uint8_t address, uint32_t nowMs,
+                           uint8_t *out, size_t size) {
+    uint8_t count = batch.size();
+    bool wide = false;
+    for (uint8_t i = 1; i < count; i++) {
+        if (batch.sample(i).timestamp - batch.sample(i - 1).timestamp > 0xFFFF) {
+            wide = true;  // A gap of over a minute, e.g. in the backlog
+        }
+    }
+
+    ByteWriter w(out, size);
+    w.u8('B');
+    w.u8('M');
+    w.u8(PAYLOAD_PACKED_VERSION);
+    w.u8(wide ? PAYLOAD_FLAG_WIDE_DT : 0);
+    w.u8(bus);
+    w.u8(address);
+    w.u8(count);
+    w.u32(nowMs);
+    w.u32(count ? batch.sample(0).timestamp : 0);
+    for (uint8_t i = 0; i < count; i++) {
+        uint32_t delta = (i == 0) ? 0 : batch.sample(i).timestamp - batch.sample(i - 1).timestamp;
+        if (wide) {
+            w.u32(delta);
+        } else {
+            w.u16((uint16_t)delta);
+        }
+    }
+    for (uint8_t i = 0; i < count; i++) {
+        w.u16((uint16_t)batch.sample(i).temperature);
+    }
+    for (uint8_t i = 0; i < count; i++) {
+        w.u16(batch.sample(i).humidity);
+    }
+    for (uint8_t i = 0; i < count; i++) {
+        w.u32(batch.sample(i).pressure);
+    }
+    return w.overflowed() ? 0 : w.len();
+}
+
+inline size_t encodeCbor(const SampleBatcher &batch, uint8_t bus, uint8_t address, uint32_t nowMs,
+                         uint8_t *out, size_t size) {
+    uint8_t count = batch.size();
+    ByteWriter w(out, size);
+
+    w.cborHead(5, 11);  // Map with 11 pairs
+    w.cborText("v");     w.cborInt(PAYLOAD_PACKED_VERSION);
+    w.cborText("bus");   w.cborInt(bus);
+    w.cborText("addr");  w.cborInt(address);
+    w.cborText("n");     w.cborInt(count);
+    w.cborText("now");   w.cborHead(0, nowMs);
+    w.cborText("t0");    w.cborHead(0, count ? batch.sample(0).timestamp : 0);
+    w.cborText("scale"); w.cborInt(-2);
+
+    w.cborText("dt");
+    w.cborHead(4, count);
+    for (uint8_t i = 0; i < count; i++) {
+        w.cborHead(0, (i == 0) ? 0 : batch.sample(i).timestamp - batch.sample(i - 1).timestamp);
+    }
+    w.cborText("temperature");
+    w.cborHead(4, count);
+    for (uint8_t i = 0; i < count; i++) {
+        w.cborInt(batch.sample(i).temperature);
+    }
+    w.cborText("humidity");
+    w.cborHead(4, count);
+    for (uint8_t i = 0; i < count; i++) {
+        w.cborInt(batch.sample(i).humidity);
+    }
+    w.cborText("pressure");
+    w.cborHead(4, count);
+    for (uint8_t i = 0; i < count; i++) {
+        w.cborHead(0, batch.sample(i).pressure);
+    }
+    return w.overflowed() ? 0 : w.len();
+}
+
+// Encode in any format; returns the payload length, or 0 if it didn't fit
+inline size_t encodeBatch(PayloadFormat format, const SampleBatcher &batch, uint8_t bus, uint8_t address,
+                          uint32_t nowMs, uint8_t *out, size_t size) {
+    switch (format) {
+        case PAYLOAD_PACKED:
+            return encodePacked(batch, bus, address, nowMs, out, size);
+        case PAYLOAD_CBOR:
+            return encodeCbor(batch, bus, address, nowMs, out, size);
+        default: {
+            TextBuffer json((char *)out, size);
+            batch.build(json, bus, address, nowMs);
+            return json.overflowed() ? 0 : json.len();
+        }
+    }
+}
+
+// === Decoders ===
+
+// Bounded byte reader - any read past the end sets 'bad' and returns 0
+class ByteReader {
+private:
+    const uint8_t *data;
+    size_t size;
+    size_t pos;
+
+public:
+    bool bad;
+
+    ByteReader(const uint8_t *d, size_t n) : data(d), size(n), pos(0), bad(false) {}
+
+    uint8_t u8() {
+        if (pos >= size) {
+            bad = true;
+            return 0;
+        }
+        return data[pos++];
+    }
+    uint16_t u16() {
+        uint16_t lo = u8();
+        return (uint16_t)(lo | (u8() << 8));
+    }
+    uint32_t u32() {
+        uint32_t lo = u16();
+        return lo | ((uint32_t)u16() << 16);
+    }
+    uint32_t be(uint8_t bytes) {
+        uint32_t v = 0;
+        while (bytes--) {
+            v = (v << 8) | u8();
+        }
+        return v;
+    }
+    bool atEnd() const { return pos == size; }
+    const uint8_t *take(size_t n) {
+        if (pos + n > size) {
+            bad = true;
+            return nullptr;
+        }
+        const uint8_t *p = data + pos;
+        pos += n;
+        return p;
+    }
+
+    // CBOR item head: returns the major type and puts the argument in 'value'
+    // Only the encodings our encoder produces are accepted (no 64-bit, no indefinite)
+    uint8_t cborHead(uint32_t &value) {
+        uint8_t initial = u8();
+        uint8_t info = initial & 0x1F;
+        if (info < 24) {
+            value = info;
+        } else if (info == 24) {
+            value = be(1);
+        } else if (info == 25) {
+            value = be(2);
+        } else if (info == 26) {
+            value = be(4);
+        } else {
+            bad = true;
+            value = 0;
+        }
+        return initial >> 5;
+    }
+    int32_t cborInt() {
+        uint32_t value;
+        uint8_t major = cborHead(value);
+        if (major == 0) {
+            return (int32_t)value;
+        }
+        if (major == 1) {
+            return -1 - (int32_t)value;
+        }
+        bad = true;
+        return 0;
+    }
+};
+
+inline bool decodePacked(const uint8_t *data, size_t length, DecodedBatch &out) {
+    ByteReader r(data, length);
+    if (r.u8() != 'B' || r.u8() != 'M' || r.u8() != PAYLOAD_PACKED_VERSION) {
+        return false;
+    }
+    bool wide = (r.u8() & PAYLOAD_FLAG_WIDE_DT) != 0;
+    out.bus = r.u8();
+    out.address = r.u8();
+    out.count = r.u8();
+    out.now = r.u32();
+    uint32_t t = r.u32();
+    if (out.count > BATCH_MAX_SAMPLES) {
+        return false;
+    }
+    for (uint8_t i = 0; i < out.count; i++) {
+        t += wide ? r.u32() : r.u16();
+        out.samples[i].timestamp = t;
+    }
+    for (uint8_t i = 0; i < out.count; i++) {
+        out.samples[i].temperature = (int16_t)r.u16();
+    }
+    for (uint8_t i = 0; i < out.count; i++) {
+        out.samples[i].humidity = r.u16();
+    }
+    for (uint8_t i = 0; i < out.count; i++) {
+        out.samples[i].pressure = r.u32();
+    }
+    return !r.bad && r.atEnd();  // Trailing bytes mean it isn't our frame
+}
+
+// Only accepts what encodeCbor() writes: each of the 11 keys exactly once,
+// with the right type, and every array as long as "n" says. Anything else is
+// rejected rather than half-decoded
+inline bool decodeCbor(const uint8_t *data, size_t length, DecodedBatch &out) {
+    static const char *const keys[11] = {"v", "bus", "addr", "n", "now", "t0", "scale",
+                                         "dt", "temperature", "humidity", "pressure"};
+    ByteReader r(data, length);
+    uint32_t pairs;
+    if (r.cborHead(pairs) != 5 || pairs != 11) {
+        return false;
+    }
+
+    uint32_t n = 0, t0 = 0;
+    uint32_t deltas[BATCH_MAX_SAMPLES] = {0};
+    uint32_t lengths[4] = {0};  // Of dt, temperature, humidity, pressure
+    uint16_t seen = 0;
+    for (uint32_t p = 0; p < pairs && !r.bad; p++) {
+        uint32_t keyLength;
+        if (r.cborHead(keyLength) != 3) {
+            return false;
+        }
+        const char *key = (const char *)r.take(keyLength);
+        if (!key) {
+            return false;
+        }
+        uint8_t k = 0;
+        while (k < 11 && !(strlen(keys[k]) == keyLength && memcmp(key, keys[k], keyLength) == 0)) {
+            k++;
+        }
+        if (k == 11 || (seen & (1u << k))) {
+            return false;  // Unknown or repeated key
+        }
+        seen |= (uint16_t)(1u << k);
+
+        uint32_t value;
+        uint8_t major = r.cborHead(value);
+        if (k == 6) {
+            // "scale": always -2 (hundredths)
+            if (major != 1 || value != 1) {
+                return false;
+            }
+            continue;
+        }
+        if (k < 6) {
+            if (major != 0) {
+                return false;
+            }
+            switch (k) {
+                case 0: if (value != PAYLOAD_PACKED_VERSION) return false; break;
+                case 1: if (value > 0xFF) return false; out.bus = (uint8_t)value; break;
+                case 2: if (value > 0xFF) return false; out.address = (uint8_t)value; break;
+                case 3: if (value > BATCH_MAX_SAMPLES) return false; n = value; break;
+                case 4: out.now = value; break;
+                default: t0 = value; break;
+            }
+            continue;
+        }
+
+        // One of the arrays
+        if (major != 4 || value > BATCH_MAX_SAMPLES) {
+            return false;
+        }
+        lengths[k - 7] = value;
+        for (uint8_t i = 0; i < value; i++) {
+            if (k == 7 || k == 10) {
+                // dt and pressure are unsigned 32-bit
+                uint32_t v;
+                if (r.cborHead(v) != 0) {
+                    return false;
+                }
+                if (k == 7) {
+                    deltas[i] = v;
+                } else {
+                    out.samples[i].pressure = v;
+                }
+            } else {
+                int32_t v = r.cborInt();
+                if (k == 8 && (v < INT16_MIN || v > INT16_MAX)) {
+                    return false;
+                }
+                if (k == 9 && (v < 0 || v > UINT16_MAX)) {
+                    return false;
+                }
+                if (k == 8) {
+                    out.samples[i].temperature = (int16_t)v;
+                } else {
+                    out.samples[i].humidity = (uint16_t)v;
+                }
+            }
+        }
+    }
+
+    if (r.bad || !r.atEnd() || seen != 0x7FF) {
+        return false;
+    }
+    for (uint32_t arrayLength : lengths) {
+        if (arrayLength != n) {
+            return false;
+        }
+    }
+    out.count = (uint8_t)n;
+    for (uint8_t i = 0; i < out.count; i++) {
+        t0 += deltas[i];
+        out.samples[i].timestamp = t0;
+    }
+    return true;
+}
+
+#endif // PAYLOAD_CODEC_H
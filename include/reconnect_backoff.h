@@ -0,0 +1,116 @@
+#ifndef RECONNECT_BACKOFF_H
+#define RECONNECT_BACKOFF_H
+
+// Reconnect scheduling with exponential backoff and full jitter
+//
+// The old reconnect code tried again on every pass through loop(). When the
+// broker restarts, every device notices at the same moment and they all
+// hammer it in lockstep. With this, the wait before attempt k is a random
+// value between 0 and min(cap, base * 2^k) ("full jitter"), so the devices
+// spread out and back off while the broker is down. Even the first attempt
+// after losing the connection gets a random delay for the same reason.
+//
+// It only decides *when* to try; main.cpp runs the actual connect as a small
+// state machine, one step per loop() pass. It also counts attempts and how
+// long each connect took, so we can see how reconnects behave in the field.
+
+#include <stdint.h>
+
+#define RECONNECT_BASE_MS     1000    // Window for the first retry
+#define RECONNECT_CAP_MS      60000   // The window never grows past this
+
+typedef struct {
+    uint32_t attempts;          // Connect attempts started
+    uint32_t successes;
+    uint32_t failures;
+    uint32_t disconnects;       // Times an established connection was lost
+    uint32_t lastLatencyMs;     // Duration of the last attempt (success or not)
+    uint32_t maxLatencyMs;
+    uint32_t totalLatencyMs;    // Sum over all attempts, for the average
+    uint32_t lastBackoffMs;     // The wait we picked most recently
+} ReconnectStats;
+
+class ReconnectBackoff {
+private:
+    uint32_t baseMs;
+    uint32_t capMs;
+    uint8_t failuresInRow;
+    uint32_t nextAttemptMs;
+    uint32_t rngState;
+
+    // xorshift32 - tiny and good enough for spreading out retries
+    uint32_t nextRandom() {
+        uint32_t x = rngState;
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        rngState = x;
+        return x;
+    }
+
+    void scheduleAfter(uint32_t nowMs, uint32_t windowMs) {
+        uint32_t wait = nextRandom() % (windowMs + 1);
+        stats.lastBackoffMs = wait;
+        nextAttemptMs = nowMs + wait;
+    }
+
+    void recordLatency(uint32_t latencyMs) {
+        stats.lastLatencyMs = latencyMs;
+        stats.totalLatencyMs += latencyMs;
+        if (latencyMs > stats.maxLatencyMs) {
+            stats.maxLatencyMs = latencyMs;
+        }
+    }
+
+public:
+    ReconnectStats stats;
+
+    ReconnectBackoff(uint32_t base = RECONNECT_BASE_MS, uint32_t cap = RECONNECT_CAP_MS, uint32_t seed = 1)
+        : baseMs(base), capMs(cap), failuresInRow(0), nextAttemptMs(0) {
+        this->seed(seed);
+        stats = ReconnectStats{0, 0, 0, 0, 0, 0, 0, 0};
+    }
+
+    // Give every device its own sequence (e.g. from esp_random()),
+    // otherwise they'd all pick the same "random" delays
+    void seed(uint32_t value) { rngState = value ? value : 0x9E3779B9u; }
+
+    // The current window: base * 2^failures, capped
+    uint32_t windowMs() const {
+        uint32_t window = baseMs;
+        for (uint8_t i = 0; i < failuresInRow && window < capMs; i++) {
+            window *= 2;
+        }
+        return window < capMs ? window : capMs;
+    }
+
+    bool due(uint32_t nowMs) const { return (int32_t)(nowMs - nextAttemptMs) >= 0; }
+    uint32_t msUntilNextAttempt(uint32_t nowMs) const { return due(nowMs) ? 0 : nextAttemptMs - nowMs; }
+
+    // The connection dropped: first retry somewhere within the base window
+    void disconnected(uint32_t nowMs) {
+        stats.disconnects++;
+        failuresInRow = 0;
+        scheduleAfter(nowMs, baseMs);
+    }
+
+    void attemptStarted() { stats.attempts++; }
+
+    void succeeded(uint32_t latencyMs) {
+        stats.successes++;
+        recordLatency(latencyMs);
+        failuresInRow = 0;
+    }
+
+    // Failed attempt: the window doubles (up to the cap) and we pick a new wait
+    void failed(uint32_t nowMs, uint32_t latencyMs) {
+        stats.failures++;
+        recordLatency(latencyMs);
+        if (failuresInRow < 31) {
+            failuresInRow++;
+        }
+        scheduleAfter(nowMs, windowMs());
+    }
+};
+
+#endif // RECONNECT_BACKOFF_H
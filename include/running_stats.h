@@ -0,0 +1,71 @@
+#ifndef RUNNING_STATS_H
+#define RUNNING_STATS_H
+
+// Streaming mean / min / max / standard deviation for one channel
+//
+// The device can now sample much faster than it publishes (see
+// SET_PERIOD), so instead of throwing away everything between two publishes
+// we summarize it. This uses Welford's algorithm: it updates the mean and the
+// sum of squared differences from the mean one sample at a time, so it needs
+// the same few bytes whether the window has 5 samples or 50000, and unlike
+// the textbook "sum of x and sum of x squared" it doesn't lose all its
+// precision when the values are big and the spread is small (pressure is
+// ~101325 Pa and moves by a few Pa).
+//
+// The inputs are the same hundredths the rest of the code uses. The math is
+// done in double - on the ESP32 that's software floating point, but a few
+// microseconds per sample is nothing at 10 Hz.
+
+#include <stdint.h>
+#include <math.h>
+
+class RunningStats {
+private:
+    uint32_t n;
+    double mean;
+    double m2;        // Sum of squared differences from the current mean
+    int32_t lowest;
+    int32_t highest;
+
+    static int32_t roundToInt(double value) { return (int32_t)(value < 0 ? value - 0.5 : value + 0.5); }
+
+public:
+    RunningStats() { reset(); }
+
+    void reset() {
+        n = 0;
+        mean = 0;
+        m2 = 0;
+        lowest = 0;
+        highest = 0;
+    }
+
+    void add(int32_t value) {
+        n++;
+        double delta = value - mean;
+        mean += delta / n;
+        m2 += delta * (value - mean);  // Uses the old and the new mean - that's the trick
+
+        if (n == 1 || value < lowest) {
+            lowest = value;
+        }
+        if (n == 1 || value > highest) {
+            highest = value;
+        }
+    }
+
+    uint32_t count() const { return n; }
+    int32_t minimum() const { return lowest; }   // Not min()/max(): Arduino.h may have macros by those names
+    int32_t maximum() const { return highest; }
+    double getMean() const { return mean; }
+
+    // Sample variance (divides by n - 1), 0 with fewer than two samples
+    double variance() const { return n > 1 ? m2 / (n - 1) : 0.0; }
+    double stddev() const { return sqrt(variance()); }
+
+    // Rounded to whole hundredths, ready for formatCenti()
+    int32_t meanCenti() const { return roundToInt(mean); }
+    int32_t stddevCenti() const { return roundToInt(stddev()); }
+};
+
+#endif // RUNNING_STATS_H
@@ -0,0 +1,255 @@
+#ifndef SAMPLE_BUFFER_H
+#define SAMPLE_BUFFER_H
+
+// Store-and-forward buffer for sensor samples
+//
+// When the MQTT broker is unreachable, publishSensorData() used to just drop
+// the sample. Now it goes into this buffer instead and gets sent later, once
+// the connection is back (see drainBacklog() in main.cpp).
+//
+// - The samples live in a fixed array allocated up front, so there's no
+//   malloc while we're offline and no heap fragmentation afterwards
+// - Each sample is a compact 12-byte binary record, not a JSON string
+// - When RAM fills up, the oldest half can be spilled to a file (LittleFS on
+//   the ESP32, a normal file on the native build). Without a spill store the
+//   oldest samples are overwritten and counted as dropped. When the spill
+//   store is full too, its oldest samples make room, so what's lost is
+//   always the oldest data and never a piece from the middle
+// - peek()/pop() are separate so a sample is only removed once its publish
+//   actually went through
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#define SAMPLE_BUFFER_CAPACITY   256    // Samples kept in RAM (12 bytes each)
+#define SAMPLE_SPILL_MAX         8192   // Samples kept in the spill file at most
+#define SAMPLE_SPILL_CACHE       16     // Spilled samples read back per file access
+
+// One buffered sample - the same hundredths as SensorData, plus when it was taken
+typedef struct {
+    uint32_t timestamp;    // millis() when the sample was taken
+    uint32_t pressure;     // Pa (0.01 hPa)
+    int16_t  temperature;  // 0.01 °C (-327.68 .. 327.67 is plenty)
+    uint16_t humidity;     // 0.01 %RH
+} BufferedSample;
+
+// Where samples go when the RAM buffer is full
+// Works like a queue: append() at the back, peek()/pop() at the front
+class SampleSpillStore {
+public:
+    virtual ~SampleSpillStore() {}
+    virtual bool append(const BufferedSample *samples, uint16_t count) = 0;
+    virtual bool peek(BufferedSample &sample) = 0;
+    virtual void pop() = 0;
+    virtual uint32_t size() = 0;
+    virtual uint32_t capacity() = 0;
+    virtual void clear() = 0;
+};
+
+// Spill store on top of a plain file. Only uses stdio, so it works on the
+// native build and on the ESP32 (where LittleFS shows up under "/littlefs")
+// The file is a fixed ring of SAMPLE_SPILL_MAX records: writes go in after
+// the newest record and wrap around to the start, reads follow behind, so it
+// never grows past SAMPLE_SPILL_MAX * 12 bytes however long the outage is.
+// Once everything has been read back the file is truncated again
+class FileSampleSpillStore : public SampleSpillStore {
+private:
+    char path[64];
+    uint32_t readIndex;   // Next record to hand out (slot in the ring)
+    uint32_t count;       // Records in the file that haven't been popped
+    BufferedSample cache[SAMPLE_SPILL_CACHE];
+    uint16_t cacheStart;  // Index in the cache of record 'readIndex'
+    uint16_t cacheCount;
+
+public:
+    uint32_t fileWrites = 0;  // How many times we appended (each one is a flash write)
+
+    explicit FileSampleSpillStore(const char *filePath) : readIndex(0), count(0), cacheStart(0), cacheCount(0) {
+        strncpy(path, filePath, sizeof(path) - 1);
+        path[sizeof(path) - 1] = '\0';
+    }
+
+    bool append(const BufferedSample *samples, uint16_t n) override {
+        if (count + n > SAMPLE_SPILL_MAX) {
+            return false;
+        }
+        FILE *file = fopen(path, "r+b");
+        if (!file) {
+            file = fopen(path, "w+b");  // First write since clear() (or ever)
+        }
+        if (!file) {
+            return false;
+        }
+        // Up to the end of the ring, then the rest from slot 0. The write
+        // slot is never past the end of the file: the file only gets longer
+        // by writing at its end, until it's full size and the slots wrap
+        uint32_t writeIndex = (readIndex + count) % SAMPLE_SPILL_MAX;
+        uint16_t first = (uint16_t)(SAMPLE_SPILL_MAX - writeIndex < n ? SAMPLE_SPILL_MAX - writeIndex : n);
+        bool ok = fseek(file, (long)(writeIndex * sizeof(BufferedSample)), SEEK_SET) == 0 &&
+                  fwrite(samples, sizeof(BufferedSample), first, file) == first;
+        if (ok && n > first) {
+            ok = fseek(file, 0, SEEK_SET) == 0 &&
+                 fwrite(samples + first, sizeof(BufferedSample), n - first, file) == (size_t)(n - first);
+        }
+        fclose(file);
+        if (ok) {
+            count += n;
+            fileWrites++;
+        }
+        return ok;
+    }
+
+    bool peek(BufferedSample &sample) override {
+        if (count == 0) {
+            return false;
+        }
+        if (cacheCount == 0) {
+            // Refill the cache - one file access for several samples
+            FILE *file = fopen(path, "rb");
+            if (!file) {
+                return false;
+            }
+            // Never across the end of the ring - the next refill starts at slot 0
+            uint32_t want = count < SAMPLE_SPILL_CACHE ? count : SAMPLE_SPILL_CACHE;
+            if (want > SAMPLE_SPILL_MAX - readIndex) {
+                want = SAMPLE_SPILL_MAX - readIndex;
+            }
+            fseek(file, (long)(readIndex * sizeof(BufferedSample)), SEEK_SET);
+            cacheCount = (uint16_t)fread(cache, sizeof(BufferedSample), want, file);
+            cacheStart = 0;
+            fclose(file);
+            if (cacheCount == 0) {
+                return false;
+            }
+        }
+        sample = cache[cacheStart];
+        return true;
+    }
+
+    void pop() override {
+        if (count == 0) {
+            return;
+        }
+        readIndex = (readIndex + 1) % SAMPLE_SPILL_MAX;
+        count--;
+        if (cacheCount > 0) {
+            cacheStart++;
+            cacheCount--;
+        }
+        if (count == 0) {
+            clear();  // All read back - start the file over
+        }
+    }
+
+    uint32_t size() override { return count; }
+    uint32_t capacity() override { return SAMPLE_SPILL_MAX; }
+
+    void clear() override {
+        FILE *file = fopen(path, "wb");
+        if (file) {
+            fclose(file);
+        }
+        readIndex = 0;
+        count = 0;
+        cacheCount = 0;
+    }
+};
+
+class SampleBuffer {
+private:
+    BufferedSample ring[SAMPLE_BUFFER_CAPACITY];
+    uint16_t head;   // Oldest sample
+    uint16_t count;
+    SampleSpillStore *spill;
+
+    // Move the oldest half of the ring to the spill store in one go
+    // (at most two appends when it wraps around the end of the array)
+    bool spillOldest() {
+        uint16_t n = SAMPLE_BUFFER_CAPACITY / 2;
+        // Spill store full: the oldest samples overall are at its front, so
+        // those are the ones to lose (their slots get the new records)
+        while (spill->size() > 0 && spill->size() + n > spill->capacity()) {
+            spill->pop();
+            dropped++;
+        }
+        uint16_t first = (uint16_t)(SAMPLE_BUFFER_CAPACITY - head);
+        if (first > n) {
+            first = n;
+        }
+        if (!spill->append(&ring[head], first)) {
+            return false;
+        }
+        if (n > first && !spill->append(&ring[0], (uint16_t)(n - first))) {
+            // The first part made it, so at least drop those from RAM
+            n = first;
+        }
+        head = (uint16_t)((head + n) % SAMPLE_BUFFER_CAPACITY);
+        count = (uint16_t)(count - n);
+        spilled += n;
+        return true;
+    }
+
+public:
+    // Statistics
+    uint32_t dropped = 0;   // Lost because RAM (and spill) were full
+    uint32_t spilled = 0;   // Moved from RAM to the spill store
+
+    SampleBuffer() : head(0), count(0), spill(nullptr) {}
+
+    void setSpillStore(SampleSpillStore *store) { spill = store; }
+
+    void push(const BufferedSample &sample) {
+        if (count == SAMPLE_BUFFER_CAPACITY) {
+            if (spill && !spillOldest() && spill->size() > 0) {
+                // Can't write the spill file, and it holds older samples
+                // than RAM: overwriting the oldest RAM sample would cut a
+                // hole in the middle, so this one is lost instead
+                dropped++;
+                return;
+            }
+            if (count == SAMPLE_BUFFER_CAPACITY) {
+                // Nowhere to put it - overwrite the oldest
+                head = (uint16_t)((head + 1) % SAMPLE_BUFFER_CAPACITY);
+                count--;
+                dropped++;
+            }
+        }
+        ring[(head + count) % SAMPLE_BUFFER_CAPACITY] = sample;
+        count++;
+    }
+
+    // Oldest sample first: everything in the spill store is older than RAM
+    bool peek(BufferedSample &sample) {
+        if (spill && spill->size() > 0) {
+            if (spill->peek(sample)) {
+                return true;
+            }
+            // Can't read the spill file back - count it as lost and move on
+            // to RAM rather than getting stuck here forever
+            dropped += spill->size();
+            spill->clear();
+        }
+        if (count == 0) {
+            return false;
+        }
+        sample = ring[head];
+        return true;
+    }
+
+    void pop() {
+        if (spill && spill->size() > 0) {
+            spill->pop();
+            return;
+        }
+        if (count > 0) {
+            head = (uint16_t)((head + 1) % SAMPLE_BUFFER_CAPACITY);
+            count--;
+        }
+    }
+
+    uint32_t size() { return count + (spill ? spill->size() : 0); }
+    bool empty() { return size() == 0; }
+};
+
+#endif // SAMPLE_BUFFER_H
@@ -0,0 +1,82 @@
+#ifndef SCREEN_LAYOUT_H
+#define SCREEN_LAYOUT_H
+
+// Where everything on the 240 x 240 screen goes, what it says and in which
+// color
+//
+// main.cpp draws the screen on the TFT, and SimulatedScreen
+// (simulation_screen.h) draws the same thing on the simulated display for the
+// golden-image tests. Both take every position, string and color from here,
+// so moving something in the firmware moves it in the goldens too (and the
+// goldens fail until they're updated on purpose).
+
+#include <stdint.h>
+#include <string.h>
+#include "display_widgets.h"
+
+// RGB565, the same values as TFT_BLACK, TFT_WHITE etc. in TFT_eSPI
+#define SCREEN_BACKGROUND       0x0000  // Black
+#define SCREEN_TEXT             0xFFFF  // White
+#define SCREEN_STATUS           0x07E0  // Green, "good/connected"
+#define SCREEN_ERROR            0xF800  // Red, errors and "disconnected"
+#define SCREEN_TITLE            0x07FF  // Cyan, the title and the readings
+
+#define SCREEN_WIDTH            240
+#define SCREEN_MARGIN           10      // Left edge of all the text
+
+// Title (text size 2), the line under it, and the first message
+#define SCREEN_TITLE_Y          5
+#define SCREEN_TITLE_TEXT       "BME280 Sensor"
+#define SCREEN_SEPARATOR_Y      25
+#define SCREEN_STARTING_Y       40
+#define SCREEN_STARTING_TEXT    "Starting system..."
+
+// Boot messages. Each one clears its band of the screen first
+#define SCREEN_WIFI_BAND_Y      20
+#define SCREEN_WIFI_BAND_HEIGHT 40
+#define SCREEN_WIFI_Y           30
+#define SCREEN_WIFI_IP_Y        50
+#define SCREEN_WIFI_CONNECTING  "Connecting to WiFi..."
+#define SCREEN_WIFI_CONNECTED   "WiFi: Connected"
+#define SCREEN_WIFI_FAILED      "WiFi: Failed!"
+#define SCREEN_WIFI_DOT         "."     // One per failed attempt, after SCREEN_WIFI_CONNECTING
+
+#define SCREEN_SENSOR_BAND_Y    60
+#define SCREEN_SENSOR_BAND_HEIGHT 20
+#define SCREEN_SENSOR_Y         70
+#define SCREEN_SENSOR_STARTING  "BME280: Starting..."
+#define SCREEN_SENSOR_OK        "BME280: OK ("  // + count + SCREEN_SENSOR_ONE / _MANY
+#define SCREEN_SENSOR_ONE       " sensor)"
+#define SCREEN_SENSOR_MANY      " sensors)"
+#define SCREEN_SENSOR_MISSING   "BME280: Not Found!"
+
+// After boot: the MQTT line, the three readings and the LED line
+#define SCREEN_STATUS_Y         95
+#define SCREEN_MQTT_CONNECTED   "MQTT: Connected"
+#define SCREEN_MQTT_DISCONNECTED "MQTT: Disconnected"
+#define SCREEN_READINGS         3
+#define SCREEN_LED_Y            175
+#define SCREEN_LED_LABEL        "LED Status: "
+#define SCREEN_LED_ON           "ON"
+#define SCREEN_LED_OFF          "OFF"
+
+// The readings, top to bottom: label, then the value in SCREEN_TITLE with
+// one decimal and the unit
+static const char *const screenReadingLabels[SCREEN_READINGS] = {"Temperature: ", "Humidity: ", "Pressure: "};
+static const char *const screenReadingUnits[SCREEN_READINGS] = {" C", " %", " hPa"};
+
+inline int16_t screenReadingY(uint8_t reading) { return (int16_t)(115 + 20 * reading); }
+
+// Where a value goes: right after its label
+inline int16_t screenAfterLabel(const char *label) {
+    return (int16_t)(SCREEN_MARGIN + strlen(label) * WIDGET_CHAR_WIDTH);
+}
+
+// The reset button
+#define SCREEN_BUTTON_X         60
+#define SCREEN_BUTTON_Y         200
+#define SCREEN_BUTTON_WIDTH     120
+#define SCREEN_BUTTON_HEIGHT    30
+#define SCREEN_BUTTON_LABEL     "RESET"
+
+#endif // SCREEN_LAYOUT_H
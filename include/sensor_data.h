@@ -0,0 +1,30 @@
+#ifndef SENSOR_DATA_H
+#define SENSOR_DATA_H
+
+// The sensor readings the rest of the code passes around
+//
+// Everything is kept in hundredths as integers (straight from the driver's
+// fixed-point math) and printed with fixed_format.h, so there's no float
+// conversion or float printf anywhere between the sensor and MQTT.
+// This used to live in main.cpp; it's here now so the sample queue between
+// the two cores (and the native simulator) can use it too.
+
+#include <stdint.h>
+
+typedef struct {
+    int32_t temperature;  // in 0.01 Celsius (2350 = 23.50 C)
+    int32_t humidity;     // in 0.01 % relative humidity
+    int32_t pressure;     // in 0.01 hPa, which is just Pa
+} SensorData;
+
+// One reading on its way from the sensor core to the network core
+typedef struct {
+    uint32_t timestamp;   // millis() when it was read
+    uint8_t sensor;       // Index in the bus manager
+    uint8_t bus;          // Which I2C bus and address - goes into the payload header
+    uint8_t address;
+    bool primary;         // The one on the display (and the one kept in the backlog)
+    SensorData data;
+} SensorSample;
+
+#endif // SENSOR_DATA_H
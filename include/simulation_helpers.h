@@ -15,10 +15,21 @@
 #include <ctime>
 #include <random>
 #include <sstream>
+#include <tuple>
+#include "bme280_emulator.h"
+#include "glcd_font.h"
+#include "frame_export.h"
 
 // This class mimics the ST7789 display
 // It keeps track of what would be shown on a real display
 // and can save screenshots for documentation
+//
+// It has the same drawing functions main.cpp uses on TFT_eSPI, and they
+// really draw into the RGB565 frame buffer: rectangles, lines, pixels, text
+// in the GLCD font (with or without a background color, any text size) and
+// images pushed with pushImage()/pushImageDMA(). So the simulator's
+// screenshots show what the panel would show, pixel for pixel, and the
+// widget and sprite code can be run (and timed) against it without hardware.
 class SimulatedDisplay {
 public:
     static const int WIDTH = 240;   // My display is 240x240 pixels
@@ -34,35 +45,223 @@ public:
     int textSize = 1;
     uint16_t textColor = 0xFFFF;  // White text by default
     uint16_t bgColor = 0x0000;    // Black background
+    bool textBackground = true;   // false after setTextColor(color): only the glyph pixels are drawn
+    bool swapBytes = false;       // Like TFT_eSPI: pushImage() data is in panel byte order unless set
+
+    // How much drawing went on, for the benchmarks
+    uint32_t pixelsWritten = 0;
+    uint32_t drawCalls = 0;
+
+    SimulatedDisplay() { clearFrame(0x0000); }
+
+    // Fills the buffer without counting it as drawing (a new panel is black)
+    void clearFrame(uint16_t color) {
+        for (int i = 0; i < PIXELS; i++) {
+            frameBuffer[i] = color;
+        }
+    }
+
+    uint16_t getPixel(int x, int y) const {
+        return (x >= 0 && x < WIDTH && y >= 0 && y < HEIGHT) ? frameBuffer[y * WIDTH + x] : 0;
+    }
+
+    // --- The TFT_eSPI functions main.cpp uses ---
+
+    void init() {}
+    void setRotation(int) {}   // Portrait only, like the real one
+    bool initDMA(bool = false) { return true; }
+    void startWrite() {}
+    void endWrite() {}
+    bool dmaBusy() const { return false; }  // The "DMA" finishes immediately here
+    void dmaWait() {}
+    void setSwapBytes(bool swap) { swapBytes = swap; }
+
+    void drawPixel(int32_t x, int32_t y, uint32_t color) {
+        drawCalls++;
+        plot(x, y, (uint16_t)color);
+    }
+
+    void fillScreen(uint32_t color) { fillRect(0, 0, WIDTH, HEIGHT, color); }
+
+    // Clipped to the screen, like on the panel
+    void fillRect(int32_t x, int32_t y, int32_t w, int32_t h, uint32_t color) {
+        drawCalls++;
+        int32_t x0 = x < 0 ? 0 : x, y0 = y < 0 ? 0 : y;
+        int32_t x1 = x + w > WIDTH ? WIDTH : x + w, y1 = y + h > HEIGHT ? HEIGHT : y + h;
+        for (int32_t row = y0; row < y1; row++) {
+            uint16_t *pixel = &frameBuffer[row * WIDTH + x0];
+            for (int32_t column = x0; column < x1; column++) {
+                *pixel++ = (uint16_t)color;
+            }
+        }
+        if (x1 > x0 && y1 > y0) {
+            pixelsWritten += (uint32_t)((x1 - x0) * (y1 - y0));
+        }
+    }
+
+    void drawRect(int32_t x, int32_t y, int32_t w, int32_t h, uint32_t color) {
+        if (w <= 0 || h <= 0) {
+            return;
+        }
+        fillRect(x, y, w, 1, color);
+        fillRect(x, y + h - 1, w, 1, color);
+        fillRect(x, y + 1, 1, h - 2, color);
+        fillRect(x + w - 1, y + 1, 1, h - 2, color);
+    }
+
+    // Bresenham, both end points included (like TFT_eSPI)
+    void drawLine(int32_t x0, int32_t y0, int32_t x1, int32_t y1, uint32_t color) {
+        drawCalls++;
+        int32_t dx = x1 > x0 ? x1 - x0 : x0 - x1;
+        int32_t dy = y1 > y0 ? y0 - y1 : y1 - y0;  // Negative
+        int32_t stepX = x0 < x1 ? 1 : -1, stepY = y0 < y1 ? 1 : -1;
+        int32_t error = dx + dy;
+        for (;;) {
+            plot(x0, y0, (uint16_t)color);
+            if (x0 == x1 && y0 == y1) {
+                break;
+            }
+            int32_t twice = 2 * error;
+            if (twice >= dy) {
+                error += dy;
+                x0 += stepX;
+            }
+            if (twice <= dx) {
+                error += dx;
+                y0 += stepY;
+            }
+        }
+    }
+
+    // One character cell of the GLCD font: 6 x 8 pixels times the size. With
+    // bg == color only the glyph is drawn (transparent background)
+    void drawChar(int32_t x, int32_t y, uint16_t c, uint32_t color, uint32_t bg, uint8_t size) {
+        drawCalls++;
+        const uint8_t *glyph = glcdGlyph((char)c);
+        bool opaque = (bg != color);
+        for (int32_t column = 0; column < GLCD_CELL_WIDTH; column++) {
+            uint8_t bits = column < GLCD_CHAR_COLUMNS ? glyph[column] : 0;
+            for (int32_t row = 0; row < GLCD_CELL_HEIGHT; row++) {
+                bool on = (bits >> row) & 1;
+                if (!on && !opaque) {
+                    continue;
+                }
+                uint16_t value = (uint16_t)(on ? color : bg);
+                for (int32_t dy = 0; dy < size; dy++) {
+                    for (int32_t dx = 0; dx < size; dx++) {
+                        plot(x + column * size + dx, y + row * size + dy, value);
+                    }
+                }
+            }
+        }
+    }
+
+    void pushImage(int32_t x, int32_t y, int32_t w, int32_t h, const uint16_t *data) {
+        drawCalls++;
+        for (int32_t row = 0; row < h; row++) {
+            for (int32_t column = 0; column < w; column++) {
+                uint16_t value = data[row * w + column];
+                plot(x + column, y + row, swapBytes ? value : (uint16_t)((value << 8) | (value >> 8)));
+            }
+        }
+    }
+
+    void pushImageDMA(int32_t x, int32_t y, int32_t w, int32_t h, const uint16_t *data, uint16_t * = nullptr) {
+        pushImage(x, y, w, h, data);
+    }
+
+    void setCursor(int x, int y) {
+        cursorX = x;
+        cursorY = y;
+    }
+    int16_t getCursorX() const { return (int16_t)cursorX; }
+    int16_t getCursorY() const { return (int16_t)cursorY; }
+
+    void setTextSize(int size) { textSize = size < 1 ? 1 : size; }
+
+    void setTextColor(uint16_t color) {
+        textColor = color;
+        textBackground = false;
+    }
+
+    void setTextColor(uint16_t color, uint16_t background) {
+        textColor = color;
+        bgColor = background;
+        textBackground = (background != color);
+    }
+
+    // Text at the cursor, moving it along; '\n' goes to the start of the
+    // next line and text wraps at the right edge, like TFT_eSPI
+    void print(const char *text) {
+        for (; *text; text++) {
+            if (*text == '\n') {
+                cursorX = 0;
+                cursorY += GLCD_CELL_HEIGHT * textSize;
+                continue;
+            }
+            if (cursorX + GLCD_CELL_WIDTH * textSize > WIDTH) {
+                cursorX = 0;
+                cursorY += GLCD_CELL_HEIGHT * textSize;
+            }
+            drawChar(cursorX, cursorY, (uint8_t)*text, textColor, textBackground ? bgColor : textColor,
+                     (uint8_t)textSize);
+            cursorX += GLCD_CELL_WIDTH * textSize;
+        }
+    }
+    void print(const std::string &text) { print(text.c_str()); }
+    void print(long value) { print(std::to_string(value)); }
+    void print(int value) { print(std::to_string(value)); }
+    void print(unsigned value) { print(std::to_string(value)); }
+    template <typename T> void println(const T &value) { print(value); print("\n"); }
+
+    // Adafruit-style text size (the firmware centers the button label with it)
+    void getTextBounds(const std::string &text, int16_t x, int16_t y,
+                       int16_t *x1, int16_t *y1, uint16_t *w, uint16_t *h) const {
+        *x1 = x;
+        *y1 = y;
+        *w = (uint16_t)(text.size() * GLCD_CELL_WIDTH * textSize);
+        *h = (uint16_t)(GLCD_CELL_HEIGHT * textSize);
+    }
     
+    // Saves the current display state as a binary PPM (P6) image, built in
+    // memory and written in one go (see frame_export.h)
     void saveFrame(const std::string& filename) {
-        // Creates a PPM image file of the current display state
-        std::ofstream outFile(filename);
-        if (!outFile.is_open()) {
+        std::vector<uint8_t> image;
+        encodeP6(frameBuffer, WIDTH, HEIGHT, image);
+        if (!writeFile(filename, image)) {
             std::cerr << "Could not open file for writing: " << filename << std::endl;
             return;
         }
-        
-        // PPM header
-        outFile << "P3\n" << WIDTH << " " << HEIGHT << "\n255\n";
-        
-        for (int y = 0; y < HEIGHT; y++) {
-            for (int x = 0; x < WIDTH; x++) {
-                uint16_t pixel = frameBuffer[y * WIDTH + x];
-                // Convert RGB565 to RGB888
-                int r = ((pixel >> 11) & 0x1F) * 255 / 31;
-                int g = ((pixel >> 5) & 0x3F) * 255 / 63;
-                int b = (pixel & 0x1F) * 255 / 31;
-                
-                outFile << r << " " << g << " " << b << " ";
-            }
-            outFile << "\n";
+        std::cout << "Display state saved to " << filename << std::endl;
+    }
+    
+    // The same as a PNG, for viewers that don't know PPM
+    void savePng(const std::string& filename) {
+        std::vector<uint8_t> image;
+        encodePng(frameBuffer, WIDTH, HEIGHT, image);
+        if (!writeFile(filename, image)) {
+            std::cerr << "Could not open file for writing: " << filename << std::endl;
+            return;
         }
-        
-        outFile.close();
         std::cout << "Display state saved to " << filename << std::endl;
     }
     
+    // Recording: after startRecording(), every call to frameDone() counts as
+    // one displayed frame and every Nth of them goes into the sequence file
+    FrameRecorder recorder;
+    
+    bool startRecording(const std::string& filename, uint32_t everyN) {
+        if (!recorder.open(filename, WIDTH, HEIGHT, everyN)) {
+            std::cerr << "Could not open file for writing: " << filename << std::endl;
+            return false;
+        }
+        return true;
+    }
+    
+    void frameDone() { recorder.frame(frameBuffer); }
+    
+    void stopRecording() { recorder.close(); }
+    
     // Record of display calls for generating documentation
     std::vector<std::string> displayLog;
     
@@ -85,10 +284,22 @@ public:
         outFile.close();
         std::cout << "Display log saved to " << filename << std::endl;
     }
+
+private:
+    void plot(int32_t x, int32_t y, uint16_t color) {
+        if (x >= 0 && x < WIDTH && y >= 0 && y < HEIGHT) {
+            frameBuffer[y * WIDTH + x] = color;
+            pixelsWritten++;
+        }
+    }
 };
 
 // This class generates realistic environmental data
 // to simulate what a real BME280 sensor would provide
+//
+// It doesn't hand out readings itself any more: it sets the "weather" on a
+// register-level emulated chip (bme280_emulator.h), and the simulation reads
+// that chip through the real BME280_Driver over an emulated I2C bus
 class SimulatedBME280 {
 private:
     // Random number generator to create realistic variations
@@ -101,26 +312,26 @@ private:
     std::normal_distribution<float> presDist;  // Pressure distribution
     
 public:
+    // The emulated chip itself - attach it to a BME280_EmulatedTransport
+    BME280_Emulator chip;
+    
     SimulatedBME280() : 
         rng(std::time(nullptr)),  // Seed with current time
         // These parameters produce realistic indoor environmental readings
         tempDist(22.0f, 2.0f),     // Room temp around 22°C ± 2°C
         humidDist(60.0f, 10.0f),   // Indoor humidity ~60% ± 10%
-        presDist(1013.25f, 5.0f)   // Standard atm pressure with small changes
-    {}
-    
-    float getTemperature() {
-        return tempDist(rng);
+        presDist(1013.25f, 5.0f),  // Standard atm pressure with small changes
+        chip(0x76)
+    {
     }
     
-    float getHumidity() {
+    // Draw new environmental values - the chip "measures" them at its next conversion
+    void updateEnvironment() {
         float h = humidDist(rng);
-        return (h < 0.0f) ? 0.0f : (h > 100.0f) ? 100.0f : h;
-    }
-    
-    float getPressure() {
         float p = presDist(rng);
-        return (p < 900.0f) ? 900.0f : (p > 1100.0f) ? 1100.0f : p;
+        h = (h < 0.0f) ? 0.0f : (h > 100.0f) ? 100.0f : h;
+        p = (p < 900.0f) ? 900.0f : (p > 1100.0f) ? 1100.0f : p;
+        chip.setEnvironment(tempDist(rng), h, p);
     }
     
     // Records of calls for documentation
@@ -305,6 +516,15 @@ extern SimulatedDisplay simDisplay;
 extern SimulatedBME280 simSensor;
 extern SimulatedMQTT simMqtt;
 
+// Native benchmarks and self-checks (simulation_benchmarks.cpp)
+// Returns 0 if every check passed, so it can be used as an exit code
+int runBenchmarks(const std::string &which);
+
+// Golden-image tests of the display (simulation_golden.cpp): draws the
+// scripted scenarios and compares them with the PNGs in 'directory', or
+// with update = true saves them as the new goldens. Returns 0 if all match
+int runGoldenTests(bool update, const std::string &directory);
+
 #endif // SIMULATION_MODE
 
 #endif // SIMULATION_HELPERS_H
@@ -0,0 +1,153 @@
+#ifndef SIMULATION_SCREEN_H
+#define SIMULATION_SCREEN_H
+
+// The firmware's screen, drawn on a SimulatedDisplay
+//
+// Drawn step for step like setupDisplay(), setupWiFi(), setupBME280(),
+// serviceBME280(), updateDisplay() and drawButton() in main.cpp, with the
+// positions, strings and colors from screen_layout.h that those use too, and
+// the same widgets for the text and sprites for the readings (DMA mode). The
+// simulated scenario uses it for its screenshot, and the golden-image tests
+// (simulation_golden.cpp) use it to draw their scripted scenarios, each on
+// its own display.
+
+#ifdef SIMULATION_MODE
+#include "simulation_helpers.h"
+#include "bme280_compensation.h"
+#include "fixed_format.h"
+#include "display_widgets.h"
+#include "sprite_field.h"
+#include "screen_layout.h"
+#include <chrono>
+
+inline uint32_t simClock() {
+    return (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+class SimulatedScreen {
+private:
+    SimulatedDisplay &display;
+    TextWidget widgets[6];   // MQTT status, the three labels, the LED label and state
+    SpriteField fields[SCREEN_READINGS];
+    WidgetRenderer<SimulatedDisplay> renderer;
+    int16_t dotX, dotY;      // Where the next WiFi progress dot goes
+
+    // Clear a band of the screen and print one line in it
+    void showLine(int bandY, int bandHeight, int y, const char *text, uint16_t color) {
+        display.fillRect(0, bandY, SCREEN_WIDTH, bandHeight, SCREEN_BACKGROUND);
+        display.setCursor(SCREEN_MARGIN, y);
+        display.setTextColor(color, SCREEN_BACKGROUND);
+        display.print(text);
+    }
+
+public:
+    explicit SimulatedScreen(SimulatedDisplay &target)
+        : display(target), renderer(target, SCREEN_BACKGROUND, simClock), dotX(0), dotY(0) {}
+
+    // setupDisplay(): title, separator and "Starting system...". Also what
+    // the RESET command draws again
+    void drawScreen() {
+        display.fillScreen(SCREEN_BACKGROUND);
+        display.setTextSize(2);
+        display.setTextColor(SCREEN_TITLE, SCREEN_BACKGROUND);
+        display.setCursor(SCREEN_MARGIN, SCREEN_TITLE_Y);
+        display.println(SCREEN_TITLE_TEXT);
+        display.drawLine(0, SCREEN_SEPARATOR_Y, SCREEN_WIDTH, SCREEN_SEPARATOR_Y, SCREEN_TITLE);
+        display.setTextSize(1);
+        display.setTextColor(SCREEN_TEXT, SCREEN_BACKGROUND);
+        display.setCursor(SCREEN_MARGIN, SCREEN_STARTING_Y);
+        display.println(SCREEN_STARTING_TEXT);
+
+        widgets[0].place(SCREEN_MARGIN, SCREEN_STATUS_Y);
+        for (uint8_t i = 0; i < SCREEN_READINGS; i++) {
+            widgets[1 + i].place(SCREEN_MARGIN, screenReadingY(i));
+            fields[i].place(screenAfterLabel(screenReadingLabels[i]), screenReadingY(i), SPRITE_FIELD_MAX_CHARS);
+            fields[i].cleared();
+        }
+        widgets[4].place(SCREEN_MARGIN, SCREEN_LED_Y);
+        widgets[5].place(screenAfterLabel(SCREEN_LED_LABEL), SCREEN_LED_Y);
+        for (TextWidget &widget : widgets) {
+            widget.cleared();
+        }
+    }
+
+    // setupWiFi(): the message, one dot per failed attempt (always on the
+    // WiFi line, whatever was drawn in between), then the result
+    void showWiFiConnecting() {
+        showLine(SCREEN_WIFI_BAND_Y, SCREEN_WIFI_BAND_HEIGHT, SCREEN_WIFI_Y, SCREEN_WIFI_CONNECTING, SCREEN_TEXT);
+        dotX = display.getCursorX();
+        dotY = display.getCursorY();
+    }
+    void showWiFiAttempt() {
+        display.setTextColor(SCREEN_TEXT, SCREEN_BACKGROUND);
+        display.setCursor(dotX, dotY);
+        display.print(SCREEN_WIFI_DOT);
+        dotX = display.getCursorX();
+        dotY = display.getCursorY();
+    }
+    void showWiFiResult(bool connected, const char *ip) {
+        if (connected) {
+            showLine(SCREEN_WIFI_BAND_Y, SCREEN_WIFI_BAND_HEIGHT, SCREEN_WIFI_Y, SCREEN_WIFI_CONNECTED, SCREEN_STATUS);
+            display.setCursor(SCREEN_MARGIN, SCREEN_WIFI_IP_Y);
+            display.print(ip);
+        } else {
+            showLine(SCREEN_WIFI_BAND_Y, SCREEN_WIFI_BAND_HEIGHT, SCREEN_WIFI_Y, SCREEN_WIFI_FAILED, SCREEN_ERROR);
+        }
+    }
+
+    // setupBME280() while the sensors start up, then serviceBME280() once
+    // they're done: how many answered
+    void showSensorStarting() {
+        showLine(SCREEN_SENSOR_BAND_Y, SCREEN_SENSOR_BAND_HEIGHT, SCREEN_SENSOR_Y, SCREEN_SENSOR_STARTING, SCREEN_TEXT);
+    }
+    void showSensorResult(uint8_t ready) {
+        if (ready > 0) {
+            showLine(SCREEN_SENSOR_BAND_Y, SCREEN_SENSOR_BAND_HEIGHT, SCREEN_SENSOR_Y, SCREEN_SENSOR_OK, SCREEN_STATUS);
+            display.print((int)ready);
+            display.print(ready == 1 ? SCREEN_SENSOR_ONE : SCREEN_SENSOR_MANY);
+        } else {
+            showLine(SCREEN_SENSOR_BAND_Y, SCREEN_SENSOR_BAND_HEIGHT, SCREEN_SENSOR_Y, SCREEN_SENSOR_MISSING, SCREEN_ERROR);
+        }
+    }
+
+    // updateDisplay(REGION_ALL without the button)
+    void update(bool online, const BME280_FixedData &data, bool led) {
+        widgets[0].set(online ? SCREEN_MQTT_CONNECTED : SCREEN_MQTT_DISCONNECTED,
+                       online ? SCREEN_STATUS : SCREEN_ERROR);
+        for (uint8_t i = 0; i < SCREEN_READINGS; i++) {
+            widgets[1 + i].set(screenReadingLabels[i], SCREEN_TEXT);
+        }
+        widgets[4].set(SCREEN_LED_LABEL, SCREEN_TEXT);
+        widgets[5].set(led ? SCREEN_LED_ON : SCREEN_LED_OFF, led ? SCREEN_STATUS : SCREEN_ERROR);
+        renderer.render(widgets, 6);
+
+        const int32_t values[SCREEN_READINGS] = {data.temperature, (int32_t)data.humidity, (int32_t)data.pressure};
+        for (uint8_t i = 0; i < SCREEN_READINGS; i++) {
+            char buffer[WIDGET_MAX_CHARS + 1];
+            TextBuffer text(buffer, sizeof(buffer));
+            text.addCenti(values[i], 1).add(screenReadingUnits[i]);
+            if (fields[i].render(buffer, SCREEN_TITLE, SCREEN_BACKGROUND)) {
+                fields[i].push(display);
+            }
+        }
+    }
+
+    // drawButton() with the reset button's place and label
+    void drawButton() {
+        const int x = SCREEN_BUTTON_X, y = SCREEN_BUTTON_Y, w = SCREEN_BUTTON_WIDTH, h = SCREEN_BUTTON_HEIGHT;
+        display.drawRect(x, y, w, h, SCREEN_TEXT);
+        display.fillRect(x + 1, y + 1, w - 2, h - 2, SCREEN_BACKGROUND);
+        display.setTextColor(SCREEN_TEXT, SCREEN_BACKGROUND);
+        display.setTextSize(1);
+        int16_t x1, y1;
+        uint16_t textWidth, textHeight;
+        display.getTextBounds(SCREEN_BUTTON_LABEL, 0, 0, &x1, &y1, &textWidth, &textHeight);
+        display.setCursor(x + (w - textWidth) / 2, y + (h - textHeight) / 2 + textHeight);
+        display.print(SCREEN_BUTTON_LABEL);
+    }
+};
+
+#endif // SIMULATION_MODE
+
+#endif // SIMULATION_SCREEN_H
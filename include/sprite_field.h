@@ -0,0 +1,126 @@
+#ifndef SPRITE_FIELD_H
+#define SPRITE_FIELD_H
+
+// A value on the screen drawn off-screen and sent to the panel by DMA
+//
+// Even with only the changed characters redrawn (display_widgets.h), every
+// character is its own drawChar() call: set the address window, send 96
+// bytes, and the CPU sits there until the SPI transfer is done. The readings
+// change on every refresh, so instead each value field is drawn into a small
+// RGB565 buffer in RAM (a "sprite") and sent with pushImageDMA(): one window,
+// and the transfer runs in the background while loop() carries on sampling.
+//
+// Double buffering: the DMA engine reads the buffer while it's being sent,
+// so we can't draw the next value into it yet. Each field has two buffers
+// and draws into the one that isn't being sent. TFT_eSPI only runs one DMA
+// transfer at a time (pushImageDMA() waits for the previous one first), so
+// a buffer that isn't the newest one sent is always free again.
+//
+// The field has a fixed width in characters; the value is padded with the
+// background, so a shorter value needs no separate clearing. The pixels are
+// stored byte-swapped (the panel wants the high byte first), so there's no
+// swapping while sending.
+
+#include <stdint.h>
+#include <string.h>
+#include "glcd_font.h"
+
+#define SPRITE_FIELD_MAX_CHARS  12   // 72 x 8 pixels, 1152 bytes per buffer
+
+// What the sprites cost, kept by the caller (render() and push() don't time
+// themselves). Separate from the text widgets' FrameStats, which count glyphs
+typedef struct {
+    uint32_t renders;     // Values drawn into a sprite
+    uint32_t pushes;      // Sprites sent to the panel
+    uint32_t bytes;       // Pixel data sent by DMA
+    uint32_t renderUs;    // Time spent drawing into sprites
+    uint32_t pushUs;      // Time spent starting transfers
+} SpriteStats;
+
+class SpriteField {
+private:
+    int16_t x, y;
+    uint8_t chars;                 // Width in characters
+    uint16_t buffers[2][SPRITE_FIELD_MAX_CHARS * GLCD_CELL_WIDTH * GLCD_CELL_HEIGHT];
+    uint8_t back;                  // The buffer render() draws into
+    bool pending;                  // Rendered but not pushed yet
+    bool valid;                    // 'shown' is what's on the screen
+    char shown[SPRITE_FIELD_MAX_CHARS + 1];
+    uint16_t shownColor;
+
+    static uint16_t swapped(uint16_t color) { return (uint16_t)((color << 8) | (color >> 8)); }
+
+public:
+    SpriteField() : x(0), y(0), chars(1), back(0), pending(false), valid(false), shownColor(0) {
+        shown[0] = '\0';
+    }
+
+    void place(int16_t left, int16_t top, uint8_t widthChars) {
+        x = left;
+        y = top;
+        chars = widthChars < SPRITE_FIELD_MAX_CHARS ? widthChars : SPRITE_FIELD_MAX_CHARS;
+    }
+
+    // The screen under the field was cleared: the next render() draws it
+    // even if the value is the same
+    void cleared() {
+        valid = false;
+        pending = false;
+    }
+
+    // Draw the text into the back buffer. Returns false (and does nothing)
+    // if that's what the field already shows. Only touches RAM, so it can run
+    // while the previous frame is still being sent
+    bool render(const char *text, uint16_t color, uint16_t background) {
+        char clipped[SPRITE_FIELD_MAX_CHARS + 1];
+        size_t length = 0;
+        while (length < chars && text[length] != '\0') {
+            clipped[length] = text[length];
+            length++;
+        }
+        clipped[length] = '\0';
+        if (valid && color == shownColor && strcmp(clipped, shown) == 0) {
+            return false;
+        }
+        memcpy(shown, clipped, length + 1);
+        shownColor = color;
+        valid = true;
+
+        const uint16_t fg = swapped(color);
+        const uint16_t bg = swapped(background);
+        const uint16_t width = widthPixels();
+        uint16_t *pixels = buffers[back];
+        for (uint8_t c = 0; c < chars; c++) {
+            const uint8_t *glyph = glcdGlyph(c < length ? shown[c] : ' ');
+            for (uint8_t column = 0; column < GLCD_CELL_WIDTH; column++) {
+                uint8_t bits = column < GLCD_CHAR_COLUMNS ? glyph[column] : 0;
+                uint16_t *pixel = pixels + c * GLCD_CELL_WIDTH + column;
+                for (uint8_t row = 0; row < GLCD_CELL_HEIGHT; row++, pixel += width) {
+                    *pixel = (bits >> row) & 1 ? fg : bg;
+                }
+            }
+        }
+        pending = true;
+        return true;
+    }
+
+    // Start sending the rendered buffer. The caller holds the bus
+    // (startWrite()) and waits for the end (dmaWait()) before drawing
+    // anything else
+    template <typename Gfx>
+    void push(Gfx &gfx) {
+        if (!pending) {
+            return;
+        }
+        gfx.pushImageDMA(x, y, widthPixels(), GLCD_CELL_HEIGHT, buffers[back]);
+        back ^= 1;  // The next render() must not touch the one in flight
+        pending = false;
+    }
+
+    bool isPending() const { return pending; }
+    uint16_t widthPixels() const { return (uint16_t)(chars * GLCD_CELL_WIDTH); }
+    uint32_t bytes() const { return (uint32_t)widthPixels() * GLCD_CELL_HEIGHT * 2; }
+    const uint16_t *frontBuffer() const { return buffers[back ^ 1]; }  // The one pushed last
+};
+
+#endif // SPRITE_FIELD_H
@@ -0,0 +1,113 @@
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+// Lock-free queue between exactly one producer and one consumer
+//
+// The sensor task (core 1) hands its readings to the network task (core 0)
+// through one of these, so neither ever waits for the other: if the network
+// side is stuck in a TCP timeout, sampling carries on and the readings pile
+// up here until it's back (or the queue is full, then new ones are dropped
+// and counted).
+//
+// How it works: a ring of Capacity slots with two counters. Only the
+// producer writes 'head' and only the consumer writes 'tail', so no locks
+// are needed - just the right memory ordering: the producer fills the slot
+// and then publishes it with a release store of head; the consumer's acquire
+// load of head guarantees it sees the slot's contents (and the same the other
+// way round for tail). On the native build the same code runs between two
+// std::threads.
+//
+// A few details that matter when it gets busy:
+// - Wait-free: push() and pop() finish in a fixed number of steps no matter
+//   what the other side is doing. There are no loops, locks or critical
+//   sections, which is also why either side may be an interrupt handler
+//   (see below).
+// - The producer's and the consumer's fields live on separate cache lines.
+//   Otherwise every push would invalidate the line the consumer is polling
+//   and the other way round ("false sharing") - a big deal between two PC
+//   cores. The ESP32 has no data cache for internal RAM, so there it just
+//   costs a few bytes.
+// - Each side keeps a private copy of the other side's counter and only
+//   re-reads the shared one when the copy says full/empty. When the queue
+//   is neither, a push or pop touches no line the other core is writing.
+//
+// Using it from an ISR: push() or pop() (not both - it's still one producer
+// and one consumer) can be called from an interrupt handler, since they never
+// block. On the ESP32 a handler registered with ESP_INTR_FLAG_IRAM also runs
+// while the flash cache is off, so then the queue itself and the code calling
+// it must be in internal RAM (IRAM_ATTR) - the template is header-only, so it
+// gets inlined into the handler. T must be plain data (it's copied with
+// assignment, no constructors run per slot).
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include <type_traits>
+
+#ifndef SPSC_CACHE_LINE
+#define SPSC_CACHE_LINE  64   // x86 and most ARM cores; harmless on the ESP32
+#endif
+
+template <typename T, size_t Capacity>
+class SpscQueue {
+    static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+    static_assert(Capacity <= 0x80000000u, "Capacity must fit the 32-bit counters");
+    static_assert(std::is_trivially_copyable<T>::value, "Queue items must be plain data");
+
+private:
+    // Producer side (written only by push())
+    alignas(SPSC_CACHE_LINE) std::atomic<uint32_t> head;  // Next slot to write
+    uint32_t tailCache;                                  // Last tail we read - the queue has at least this much room
+
+public:
+    std::atomic<uint32_t> dropped;  // push() calls that found the queue full (readable from either side)
+
+private:
+    // Consumer side (written only by pop())
+    alignas(SPSC_CACHE_LINE) std::atomic<uint32_t> tail;  // Next slot to read
+    uint32_t headCache;                                  // Last head we read - at least this much is waiting
+
+    alignas(SPSC_CACHE_LINE) T slots[Capacity];
+
+public:
+    SpscQueue() : head(0), tailCache(0), dropped(0), tail(0), headCache(0) {}
+
+    // Producer only. Returns false (and drops the item) when full
+    bool push(const T &item) {
+        uint32_t h = head.load(std::memory_order_relaxed);
+        if (h - tailCache >= Capacity) {
+            tailCache = tail.load(std::memory_order_acquire);  // Looks full - has the consumer moved on?
+            if (h - tailCache >= Capacity) {
+                dropped.store(dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+                return false;
+            }
+        }
+        slots[h & (Capacity - 1)] = item;
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer only. Returns false when empty
+    bool pop(T &item) {
+        uint32_t t = tail.load(std::memory_order_relaxed);
+        if (t == headCache) {
+            headCache = head.load(std::memory_order_acquire);  // Looks empty - has anything arrived?
+            if (t == headCache) {
+                return false;
+            }
+        }
+        item = slots[t & (Capacity - 1)];
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Either side; only a snapshot, the other side may be moving
+    uint32_t size() const {
+        uint32_t t = tail.load(std::memory_order_acquire);  // Tail first: head can only be ahead of it
+        return head.load(std::memory_order_acquire) - t;
+    }
+    bool empty() const { return size() == 0; }
+    static constexpr size_t capacity() { return Capacity; }
+};
+
+#endif // SPSC_QUEUE_H
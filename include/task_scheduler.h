@@ -0,0 +1,173 @@
+#ifndef TASK_SCHEDULER_H
+#define TASK_SCHEDULER_H
+
+// A small cooperative scheduler for loop()
+//
+// loop() used to have one 2-second timer that read the sensors, redrew the
+// display and published, all together. Now each of those is a task with its
+// own period, so we can, say, sample at 10 Hz and publish every 10 s. The
+// periods can be changed while running (SET_PERIOD over MQTT).
+//
+// It's cooperative: run() is called from loop() and calls every task whose
+// time has come, one after the other. A task must return quickly - nothing
+// can interrupt it. Each task is scheduled at a fixed rate (next = previous
+// scheduled time + period), so small delays don't add up. If a task falls a
+// whole period behind we don't try to catch up with a burst of runs, we skip
+// the missed slots and count them.
+//
+// Per task it keeps:
+// - jitter: how late each run started compared to when it was due
+// - run time: how long the task itself took
+// - overruns: runs that took longer than the period, or started so late
+//   that a slot was skipped
+
+#include <stdint.h>
+#include <string.h>
+
+#define SCHEDULER_MAX_TASKS   8
+#define SCHEDULER_MAX_PERIOD_MS  2000000  // ~33 min: half the range of the wrapping microsecond clock
+
+typedef void (*TaskFunction)();
+
+typedef struct {
+    uint32_t runs;
+    uint32_t overruns;
+    uint32_t skipped;        // Slots dropped because the task fell behind
+    uint32_t maxJitterUs;    // Latest start relative to the due time
+    uint64_t totalJitterUs;  // Sum, for the average (64 bits: the keepalive task runs ~100x a second)
+    uint32_t maxRunUs;       // Longest single run
+    uint64_t totalRunUs;
+} TaskStats;
+
+class TaskScheduler {
+private:
+    typedef struct {
+        const char *name;     // Short name for commands and stats (string literal)
+        TaskFunction function;
+        uint32_t periodUs;
+        uint32_t nextUs;      // When the next run is due
+        bool enabled;
+    } Task;
+
+    Task tasks[SCHEDULER_MAX_TASKS];
+    TaskStats taskStats[SCHEDULER_MAX_TASKS];
+    uint8_t count;
+    uint32_t (*clock)();      // Microseconds, wraps around like micros()
+    int8_t running;           // Task in the middle of its run, or -1
+    bool restarted;           // setPeriod() was called on it during that run
+
+    static bool reached(uint32_t now, uint32_t due) { return (int32_t)(now - due) >= 0; }
+
+public:
+    explicit TaskScheduler(uint32_t (*clockUs)()) : count(0), clock(clockUs), running(-1), restarted(false) {
+        memset(tasks, 0, sizeof(tasks));
+        memset(taskStats, 0, sizeof(taskStats));
+    }
+
+    // Add a task, returns its index (or -1 if the table is full). The first
+    // run is due right away
+    int8_t add(const char *name, TaskFunction function, uint32_t periodMs) {
+        if (count >= SCHEDULER_MAX_TASKS || !function || periodMs == 0 || periodMs > SCHEDULER_MAX_PERIOD_MS) {
+            return -1;
+        }
+        tasks[count].name = name;
+        tasks[count].function = function;
+        tasks[count].periodUs = periodMs * 1000;
+        tasks[count].nextUs = clock();
+        tasks[count].enabled = true;
+        return (int8_t)count++;
+    }
+
+    int8_t find(const char *name) const {
+        for (uint8_t i = 0; i < count; i++) {
+            if (strcmp(tasks[i].name, name) == 0) {
+                return (int8_t)i;
+            }
+        }
+        return -1;
+    }
+
+    // Change a period on the fly. The next run moves so that it's due at
+    // most one new period from now (a long period shortened takes effect
+    // right away instead of after the old wait). Statistics start over.
+    // A task can change its own period while it runs (SET_PERIOD keepalive
+    // arrives inside the keepalive task): run() then puts the next run one
+    // new period from now and leaves that run out of the fresh statistics
+    bool setPeriod(uint8_t index, uint32_t periodMs) {
+        if (index >= count || periodMs == 0 || periodMs > SCHEDULER_MAX_PERIOD_MS) {
+            return false;  // Any longer and the clock can't tell "due" from "not due"
+        }
+        uint32_t now = clock();
+        tasks[index].periodUs = periodMs * 1000;
+        if (running == (int8_t)index) {
+            tasks[index].nextUs = now;  // run() adds the period once it returns
+            restarted = true;
+        } else if (!reached(now + tasks[index].periodUs, tasks[index].nextUs)) {
+            tasks[index].nextUs = now + tasks[index].periodUs;
+        }
+        resetStats(index);
+        return true;
+    }
+
+    void setEnabled(uint8_t index, bool enabled) {
+        if (index < count) {
+            tasks[index].enabled = enabled;
+            tasks[index].nextUs = clock();
+        }
+    }
+
+    // Call from loop(): runs every task that's due
+    void run() {
+        for (uint8_t i = 0; i < count; i++) {
+            Task &task = tasks[i];
+            uint32_t start = clock();
+            if (!task.enabled || !reached(start, task.nextUs)) {
+                continue;
+            }
+
+            TaskStats &stats = taskStats[i];
+            uint32_t late = start - task.nextUs;
+            running = (int8_t)i;
+            restarted = false;
+            task.function();
+            uint32_t took = clock() - start;
+            running = -1;
+            bool counted = !restarted;  // Not with the old period's numbers
+
+            if (counted) {
+                stats.runs++;
+                stats.totalJitterUs += late;
+                stats.totalRunUs += took;
+                if (late > stats.maxJitterUs) {
+                    stats.maxJitterUs = late;
+                }
+                if (took > stats.maxRunUs) {
+                    stats.maxRunUs = took;
+                }
+            }
+
+            // Fixed rate: the next slot is one period after this one was due
+            task.nextUs += task.periodUs;
+            uint32_t now = start + took;
+            if (counted && (took > task.periodUs || late >= task.periodUs)) {
+                stats.overruns++;
+            }
+            if (reached(now, task.nextUs)) {
+                // Already behind: skip the missed slots instead of bursting
+                uint32_t behind = now - task.nextUs;
+                if (counted) {
+                    stats.skipped += behind / task.periodUs + 1;
+                }
+                task.nextUs = now + task.periodUs - behind % task.periodUs;
+            }
+        }
+    }
+
+    uint8_t size() const { return count; }
+    const char *name(uint8_t index) const { return tasks[index].name; }
+    uint32_t periodMs(uint8_t index) const { return tasks[index].periodUs / 1000; }
+    const TaskStats &stats(uint8_t index) const { return taskStats[index]; }
+    void resetStats(uint8_t index) { memset(&taskStats[index], 0, sizeof(TaskStats)); }
+};
+
+#endif // TASK_SCHEDULER_H
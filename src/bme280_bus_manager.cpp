@@ -0,0 +1,133 @@
+#include "bme280_bus_manager.h"
+
+BME280_BusManager::BME280_BusManager() {
+    busCount = 0;
+    sensorCount = 0;
+    calibStore = nullptr;
+    for (uint8_t i = 0; i < BME280_MAX_SENSORS; i++) {
+        configured[i] = false;
+        readings[i].valid = false;
+    }
+}
+
+int BME280_BusManager::addBus(BME280_Transport *bus) {
+    if (busCount >= BME280_MAX_BUSES) {
+        return -1;
+    }
+    buses[busCount] = bus;
+    return busCount++;
+}
+
+uint8_t BME280_BusManager::discover() {
+    const uint8_t addresses[2] = {BME280_ADDRESS_PRIMARY, BME280_ADDRESS_SECONDARY};
+
+    sensorCount = 0;
+    for (uint8_t b = 0; b < busCount; b++) {
+        for (uint8_t a = 0; a < 2; a++) {
+            if (sensorCount >= BME280_MAX_SENSORS || !buses[b]->probe(addresses[a])) {
+                continue;
+            }
+
+            // Something is there - the driver's init checks it really is a BME280
+            uint8_t i = sensorCount++;
+            sensors[i] = BME280_Driver(buses[b], addresses[a]);
+            sensors[i].setCalibrationStore(calibStore, b);
+            sensors[i].beginAsync();
+            sensorBus[i] = b;
+            configured[i] = false;
+
+            readings[i].bus = b;
+            readings[i].address = addresses[a];
+            readings[i].valid = false;
+        }
+    }
+    return sensorCount;
+}
+
+bool BME280_BusManager::poll() {
+    bool allDone = true;
+
+    for (uint8_t i = 0; i < sensorCount; i++) {
+        BME280_InitState state = sensors[i].poll();
+
+        if (state == BME280_INIT_READY && !configured[i]) {
+            // We sample on demand, so use forced mode (sleep between samples)
+            BME280_Settings settings = sensors[i].getSettings();
+            settings.mode = BME280_MODE_FORCED;
+            sensors[i].setSettings(settings);
+            configured[i] = true;
+        }
+
+        if (state != BME280_INIT_READY && state != BME280_INIT_FAILED) {
+            allDone = false;
+        }
+    }
+    return allDone;
+}
+
+uint8_t BME280_BusManager::sampleAll() {
+    // Phase 1: kick off every conversion - they all run in parallel
+    uint32_t longestWaitUs = 0;
+    for (uint8_t i = 0; i < sensorCount; i++) {
+        readings[i].valid = false;
+        if (!configured[i]) {
+            continue;
+        }
+        uint32_t waitUs = sensors[i].triggerForcedMeasurement();
+        if (waitUs > longestWaitUs) {
+            longestWaitUs = waitUs;
+        }
+    }
+
+    if (longestWaitUs == 0) {
+        return 0;  // Nothing ready to sample
+    }
+
+    // Phase 2: one wait for the slowest conversion instead of one per sensor
+    // (any bus's clock will do, they all share the same time base)
+    buses[0]->delayMs((longestWaitUs + 999) / 1000);
+
+    // Phase 3: one burst read per sensor, grouped by bus so each bus gets
+    // its transactions back to back
+    uint8_t count = 0;
+    for (uint8_t b = 0; b < busCount; b++) {
+        for (uint8_t i = 0; i < sensorCount; i++) {
+            if (sensorBus[i] != b || !configured[i]) {
+                continue;
+            }
+            readings[i].data = sensors[i].readAllFixed();
+            readings[i].valid = sensors[i].readOk();  // A NAK is no reading, not a zero one
+            if (readings[i].valid) {
+                count++;
+            }
+        }
+    }
+    return count;
+}
+
+uint8_t BME280_BusManager::getReadyCount() {
+    uint8_t count = 0;
+    for (uint8_t i = 0; i < sensorCount; i++) {
+        if (configured[i]) {
+            count++;
+        }
+    }
+    return count;
+}
+
+const BME280_Reading *BME280_BusManager::getPrimaryReading() {
+    for (uint8_t i = 0; i < sensorCount; i++) {
+        if (readings[i].valid) {
+            return &readings[i];
+        }
+    }
+    return nullptr;
+}
+
+uint32_t BME280_BusManager::getTransactionCount() {
+    uint32_t total = 0;
+    for (uint8_t i = 0; i < sensorCount; i++) {
+        total += sensors[i].getTransactionCount();
+    }
+    return total;
+}
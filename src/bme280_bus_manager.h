@@ -0,0 +1,72 @@
+#ifndef BME280_BUS_MANAGER_H
+#define BME280_BUS_MANAGER_H
+
+#include <stdint.h>
+#include "bme280_transport.h"
+#include "bme280_driver.h"
+
+// Our racks have up to four BME280s spread over two I2C buses (both addresses
+// on each bus). This class finds them, brings them all up with the
+// non-blocking init, and samples them together.
+#define BME280_MAX_BUSES           2
+#define BME280_MAX_SENSORS         (BME280_MAX_BUSES * 2)  // Two addresses per bus
+
+// One sensor's result from the latest sampling cycle
+typedef struct {
+    uint8_t bus;        // Index of the bus it was added with (0, 1, ...)
+    uint8_t address;    // 0x76 or 0x77
+    bool valid;         // False if the sensor wasn't ready this cycle
+    BME280_FixedData data;  // Hundredths of °C, hPa and %RH
+} BME280_Reading;
+
+class BME280_BusManager {
+private:
+    BME280_Transport *buses[BME280_MAX_BUSES];
+    uint8_t busCount;
+
+    BME280_Driver sensors[BME280_MAX_SENSORS];
+    uint8_t sensorBus[BME280_MAX_SENSORS];   // Bus index of each sensor
+    bool configured[BME280_MAX_SENSORS];     // Switched to forced mode yet?
+    uint8_t sensorCount;
+
+    BME280_Reading readings[BME280_MAX_SENSORS];
+    BME280_CalibrationStore *calibStore;
+
+public:
+    BME280_BusManager();
+
+    // Register an I2C bus transport (for TwoWire, already started with
+    // Wire.begin()) - returns its index
+    int addBus(BME280_Transport *bus);
+
+    // Shared calibration cache for all sensors (keyed by bus and address)
+    void setCalibrationStore(BME280_CalibrationStore *store) { calibStore = store; }
+
+    // Look for sensors at both addresses on every bus and start their init
+    // Returns how many devices answered
+    uint8_t discover();
+
+    // Advance every sensor's init state machine; returns true once all of them
+    // are either ready or failed. Ready sensors are switched to forced mode
+    bool poll();
+
+    // Sample every ready sensor with the conversions overlapped: trigger all of
+    // them first (one short write each), wait once for the slowest conversion,
+    // then burst-read them one after another. N sensors cost about the same
+    // wall time as one, and each bus sees its transactions back to back
+    // Returns how many sensors produced a reading
+    uint8_t sampleAll();
+
+    uint8_t getSensorCount() { return sensorCount; }
+    uint8_t getReadyCount();
+    const BME280_Reading &getReading(uint8_t index) { return readings[index]; }
+    BME280_Driver &getSensor(uint8_t index) { return sensors[index]; }
+
+    // First valid reading (what the display shows), or nullptr if none
+    const BME280_Reading *getPrimaryReading();
+
+    // Total I2C transactions over all sensors
+    uint32_t getTransactionCount();
+};
+
+#endif // BME280_BUS_MANAGER_H
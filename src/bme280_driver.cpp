@@ -1,49 +1,146 @@
 #include "bme280_driver.h"
+#include <math.h>
+#include <string.h>
 
 // Constructor - just store the I2C interface and address for later use
-BME280_Driver::BME280_Driver(TwoWire *w, uint8_t addr) {
-    wire = w;  // Which I2C interface to use
+BME280_Driver::BME280_Driver(BME280_Transport *t, uint8_t addr) {
+    transport = t;  // Which I2C bus to use
     deviceAddress = addr;  // Which address the sensor is on
-    t_fine = 0;  // We'll calculate this later when reading temp
+    transactionCount = 0;
+    
+    // Start from the compile-time defaults, setSettings() can change them later
+    settings.tempOversampling = BME280_TEMP_OSR;
+    settings.presOversampling = BME280_PRES_OSR;
+    settings.humOversampling = BME280_HUM_OSR;
+    settings.filter = BME280_FILTER_OFF;
+    settings.standby = BME280_STANDBY_0_5_MS;
+    settings.mode = BME280_MODE;
+    
+    initState = BME280_INIT_IDLE;
+    initAttempts = 0;
+    initWaitUntil = 0;
+    nvmWaitStart = 0;
+    calibStore = nullptr;
+    calibBus = 0;
+    calibFromCache = false;
+    chipId = 0;
+    lastReadOk = false;
+    readErrors = 0;
 }
 
 bool BME280_Driver::begin() {
-    // First make sure we can talk to the sensor
-    uint8_t chipId = getChipID();
-    if (chipId != 0x60) {
-        // Hmm, not getting the right ID. Either it's not connected
-        // or it's not a BME280 (might be a BMP280 which is similar)
-        return false;  // 0x60 is the BME280's unique ID
+    // Just run the state machine to completion - every wait in it is bounded,
+    // so this can't hang even if the sensor never answers
+    beginAsync();
+    while (poll() != BME280_INIT_READY && initState != BME280_INIT_FAILED) {
+        transport->delayMs(1);
     }
-    
-    // Let's start fresh by resetting the sensor
-    reset();
-    delay(10);  // Give it a moment to reboot
-    
-    // The status register bit 0 is set while the device is copying
-    // NVM data to image registers, so let's wait until it's done
-    while (readRegister(BME280_REG_STATUS) & 0x01) {
-        delay(10);  // Keep checking every 10ms
+    return isReady();
+}
+
+void BME280_Driver::beginAsync() {
+    if (!transport) {
+        initState = BME280_INIT_FAILED;  // Nothing to talk to
+        return;
     }
+    initState = BME280_INIT_PROBE;
+    initAttempts = 0;
+    initWaitUntil = transport->millis();
+    calibFromCache = false;
+}
+
+BME280_InitState BME280_Driver::poll() {
+    if (!transport) {
+        return initState;
+    }
+    uint32_t now = transport->millis();
     
-    // Now read all the factory calibration data from the sensor
-    // This is super important - each BME280 has unique values!
-    readCalibrationData();
-    
-    // Now let's configure the sensor for our needs
-    // First set humidity oversampling (this register must be written first!)
-    writeRegister(BME280_REG_CTRL_HUM, BME280_HUM_OSR);
-    
-    // Now set temperature and pressure oversampling, and sensor mode
-    // We combine these settings into a single register value
-    uint8_t config = (BME280_TEMP_OSR << 5) | (BME280_PRES_OSR << 2) | BME280_MODE;
-    writeRegister(BME280_REG_CTRL_MEAS, config);
+    // Still waiting for something? (signed difference so millis() wrap is fine)
+    if ((int32_t)(now - initWaitUntil) < 0) {
+        return initState;
+    }
     
-    // We could set filter coefficients and standby time here,
-    // but we'll just use defaults to keep things simple
-    writeRegister(BME280_REG_CONFIG, 0x00);
+    switch (initState) {
+        case BME280_INIT_PROBE: {
+            // First make sure we can talk to the sensor
+            chipId = getChipID();
+            if (chipId != BME280_CHIP_ID) {
+                // Hmm, not getting the right ID. Either it's not connected
+                // or it's not a BME280 (might be a BMP280 which is similar)
+                initRetry(now);
+                break;
+            }
+            
+            // Warm boot? If we already know this chip's calibration we can
+            // skip the reset and the whole NVM read and configure right away.
+            // Unless the sensor was swapped for another one since: then the
+            // record is someone else's and we read the calibration again
+            if (calibStore && calibStore->load(chipId, deviceAddress, calibData, calibBus)) {
+                if (cachedCalibrationMatches()) {
+                    calibFromCache = true;
+                    initState = BME280_INIT_CONFIGURE;
+                    break;
+                }
+                calibStore->stale++;
+            }
+            
+            // Let's start fresh by resetting the sensor
+            reset();
+            nvmWaitStart = now;
+            initWaitUntil = now + BME280_STARTUP_MS;  // Give it a moment to reboot
+            initState = BME280_INIT_WAIT_NVM;
+            break;
+        }
+            
+        case BME280_INIT_WAIT_NVM:
+            // The status register bit 0 is set while the device is copying
+            // NVM data to image registers, so let's wait until it's done
+            if (readRegister(BME280_REG_STATUS) & 0x01) {
+                if (now - nvmWaitStart >= BME280_NVM_TIMEOUT_MS) {
+                    initRetry(now);  // Stuck - start over
+                } else {
+                    initWaitUntil = now + BME280_NVM_POLL_MS;
+                }
+                break;
+            }
+            initState = BME280_INIT_READ_CALIB;
+            break;
+            
+        case BME280_INIT_READ_CALIB:
+            // Now read all the factory calibration data from the sensor
+            // This is super important - each BME280 has unique values!
+            if (!readCalibrationData()) {
+                initRetry(now);  // Half a calibration is worse than none
+                break;
+            }
+            if (calibStore) {
+                calibStore->save(chipId, deviceAddress, calibData, calibBus);  // For next boot
+            }
+            initState = BME280_INIT_CONFIGURE;
+            break;
+            
+        case BME280_INIT_CONFIGURE:
+            // Now let's configure the sensor for our needs
+            setSettings(settings);
+            initState = BME280_INIT_READY;  // Everything looks good!
+            break;
+            
+        default:
+            // Idle, ready or failed - nothing to do
+            break;
+    }
     
-    return true;  // Everything looks good!
+    return initState;
+}
+
+void BME280_Driver::initRetry(uint32_t now) {
+    initAttempts++;
+    if (initAttempts >= BME280_INIT_MAX_ATTEMPTS) {
+        initState = BME280_INIT_FAILED;
+        return;
+    }
+    initState = BME280_INIT_PROBE;
+    initWaitUntil = now + BME280_INIT_RETRY_MS;
 }
 
 void BME280_Driver::reset() {
@@ -63,15 +160,18 @@ float BME280_Driver::readTemperature() {
     // Temperature data is stored across 3 registers (20 bits total)
     // We need to read all 3 and combine them
     uint8_t buffer[3];
-    readRegisters(BME280_REG_TEMP_MSB, buffer, 3);
+    if (!readRegisters(BME280_REG_TEMP_MSB, buffer, 3)) {
+        return NAN;  // The sensor didn't answer - no number is better than a made-up one
+    }
     
     // Combine the 3 bytes into a 20-bit value
     // The data is stored as MSB, LSB, XLSB (4 bits)
-    int32_t adcTemp = (buffer[0] << 12) | (buffer[1] << 4) | (buffer[2] >> 4);
+    int32_t adcTemp = ((uint32_t)buffer[0] << 12) | ((uint32_t)buffer[1] << 4) | (buffer[2] >> 4);
     
     // The raw ADC value isn't useful - we need to run it through
     // the compensation formula from the datasheet
-    int32_t tempComp = compensateTemperature(adcTemp);
+    int32_t tFine;
+    int32_t tempComp = bme280CompensateTemperature(calibData, adcTemp, tFine);
     
     // The compensated value is in 0.01°C units, so we divide by 100
     // to get degrees Celsius
@@ -79,43 +179,48 @@ float BME280_Driver::readTemperature() {
 }
 
 float BME280_Driver::readPressure() {
-    // Important! Pressure calculation depends on temperature
-    // so we need to make sure t_fine is calculated first
-    if (t_fine == 0) {
-        readTemperature();  // This will set t_fine for us
+    // Important! Pressure calculation depends on temperature (through t_fine)
+    // The pressure and temperature registers sit next to each other (0xF7-0xFC),
+    // so we read both in one burst and always use the temperature that belongs
+    // to this exact measurement - never an old one from a previous read
+    uint8_t buffer[6];
+    if (!readRegisters(BME280_REG_PRESS_MSB, buffer, 6)) {
+        return NAN;
     }
     
-    // Pressure data is also stored across 3 registers (20 bits total)
-    uint8_t buffer[3];
-    readRegisters(BME280_REG_PRESS_MSB, buffer, 3);
-    
-    // Combine the bytes just like for temperature
-    int32_t adcPres = (buffer[0] << 12) | (buffer[1] << 4) | (buffer[2] >> 4);
+    // Combine the bytes: first 3 are pressure, next 3 are temperature
+    int32_t adcPres = ((uint32_t)buffer[0] << 12) | ((uint32_t)buffer[1] << 4) | (buffer[2] >> 4);
+    int32_t adcTemp = ((uint32_t)buffer[3] << 12) | ((uint32_t)buffer[4] << 4) | (buffer[5] >> 4);
     
     // The pressure compensation formula is even more complex
-    // and needs the t_fine value we calculated in readTemperature()
-    uint32_t presComp = compensatePressure(adcPres);
-    
-    // Pressure is in Pascals, but people usually work with hPa
-    // so let's convert (1 hPa = 100 Pa)
-    return presComp / 100.0f; // Pa to hPa (hectopascals)
+    // and needs the t_fine value from the temperature formula
+    int32_t tFine;
+    bme280CompensateTemperature(calibData, adcTemp, tFine);
+    uint32_t presComp = bme280CompensatePressure(calibData, adcPres, tFine);
+    
+    // The 64-bit formula gives Pascals in Q24.8 format (24 integer bits,
+    // 8 fractional bits), but people usually work with hPa
+    // so let's convert (divide by 256, then 1 hPa = 100 Pa)
+    return presComp / 256.0f / 100.0f; // Q24.8 Pa to hPa (hectopascals)
 }
 
 float BME280_Driver::readHumidity() {
     // Just like pressure, humidity calculation also needs temperature first
-    if (t_fine == 0) {
-        readTemperature();  // This will set t_fine
+    // Temperature and humidity are neighbours too (0xFA-0xFE), so again
+    // one burst gives us both from the same measurement
+    uint8_t buffer[5];
+    if (!readRegisters(BME280_REG_TEMP_MSB, buffer, 5)) {
+        return NAN;
     }
     
-    // Humidity data is stored in 2 registers (16 bits total)
-    uint8_t buffer[2];
-    readRegisters(BME280_REG_HUM_MSB, buffer, 2);
-    
-    // Combine the two bytes
-    int32_t adcHum = (buffer[0] << 8) | buffer[1];
+    // First 3 bytes are temperature, last 2 are humidity
+    int32_t adcTemp = ((uint32_t)buffer[0] << 12) | ((uint32_t)buffer[1] << 4) | (buffer[2] >> 4);
+    int32_t adcHum = ((uint32_t)buffer[3] << 8) | buffer[4];
     
     // Now apply the humidity compensation formula
-    uint32_t humComp = compensateHumidity(adcHum);
+    int32_t tFine;
+    bme280CompensateTemperature(calibData, adcTemp, tFine);
+    uint32_t humComp = bme280CompensateHumidity(calibData, adcHum, tFine);
     
     // The formula gives humidity in Q22.10 format
     // (22 integer bits, 10 fractional bits)
@@ -123,6 +228,38 @@ float BME280_Driver::readHumidity() {
     return humComp / 1024.0f;  // Convert to %RH
 }
 
+BME280_Data BME280_Driver::readAll() {
+    // The data registers are laid out back to back from 0xF7 to 0xFE:
+    // press_msb, press_lsb, press_xlsb, temp_msb, temp_lsb, temp_xlsb, hum_msb, hum_lsb
+    // so we can grab everything in one go
+    uint8_t buffer[8];
+    BME280_Data data;
+    if (!readRegisters(BME280_REG_PRESS_MSB, buffer, 8)) {
+        // Whatever is in the buffer isn't a measurement. Callers check readOk()
+        data.temperature = data.pressure = data.humidity = NAN;
+        return data;
+    }
+    
+    // Temperature is compensated first inside bme280Compensate()
+    // since it produces the t_fine the other two need
+    BME280_CompensatedData comp = bme280Compensate(calibData, bme280ParseRawData(buffer));
+    
+    data.temperature = comp.temperature / 100.0f;
+    data.pressure = comp.pressure / 256.0f / 100.0f;  // Q24.8 Pa to hPa
+    data.humidity = comp.humidity / 1024.0f;          // Q22.10 to %RH
+    
+    return data;
+}
+
+BME280_FixedData BME280_Driver::readAllFixed() {
+    uint8_t buffer[8];
+    if (!readRegisters(BME280_REG_PRESS_MSB, buffer, 8)) {
+        BME280_FixedData none = {0, 0, 0};  // Not a reading - callers check readOk()
+        return none;
+    }
+    return bme280ToFixed(bme280Compensate(calibData, bme280ParseRawData(buffer)));
+}
+
 bool BME280_Driver::isMeasuring() {
     // Bit 3 in the status register tells us if the sensor is
     // currently doing a measurement
@@ -130,57 +267,121 @@ bool BME280_Driver::isMeasuring() {
     return (status & 0x08) != 0;  // Check if bit 3 is set
 }
 
+void BME280_Driver::setSettings(const BME280_Settings &newSettings) {
+    settings = newSettings;
+    
+    // The config register is only reliably written in sleep mode,
+    // so put the sensor to sleep first
+    writeRegister(BME280_REG_CTRL_MEAS, 0x00);
+    
+    // Humidity oversampling only takes effect after ctrl_meas is written,
+    // so it has to go before the final ctrl_meas write below
+    writeRegister(BME280_REG_CTRL_HUM, settings.humOversampling & 0x07);
+    
+    // Standby time in bits 7:5, filter in bits 4:2
+    writeRegister(BME280_REG_CONFIG, ((settings.standby & 0x07) << 5) | ((settings.filter & 0x07) << 2));
+    
+    // Forced mode starts a conversion as soon as it's written, so in that case
+    // we stay asleep and let triggerForcedMeasurement() do it on demand
+    uint8_t mode = (settings.mode == BME280_MODE_NORMAL) ? BME280_MODE_NORMAL : BME280_MODE_SLEEP;
+    writeRegister(BME280_REG_CTRL_MEAS, ((settings.tempOversampling & 0x07) << 5) |
+                                        ((settings.presOversampling & 0x07) << 2) | mode);
+}
+
+uint32_t BME280_Driver::measurementTimeUs(const BME280_Settings &s) {
+    // Turn a register setting into the number of oversamples (0 = skipped)
+    // Codes above x16 also mean x16
+    auto samples = [](uint8_t osr) -> uint32_t {
+        if (osr == BME280_OSR_SKIP) {
+            return 0;
+        }
+        return 1u << ((osr > BME280_OSR_X16 ? BME280_OSR_X16 : osr) - 1);
+    };
+    
+    uint32_t t = samples(s.tempOversampling);
+    uint32_t p = samples(s.presOversampling);
+    uint32_t h = samples(s.humOversampling);
+    
+    // All in microseconds: t_meas,max = 1.25 + 2.3*T + (2.3*P + 0.575) + (2.3*H + 0.575) ms
+    uint32_t time = 1250 + 2300 * t;
+    if (p) {
+        time += 2300 * p + 575;
+    }
+    if (h) {
+        time += 2300 * h + 575;
+    }
+    return time;
+}
+
+uint32_t BME280_Driver::triggerForcedMeasurement() {
+    // Writing forced mode to ctrl_meas starts exactly one conversion
+    // (ctrl_hum is already set, it keeps its value between measurements)
+    writeRegister(BME280_REG_CTRL_MEAS, ((settings.tempOversampling & 0x07) << 5) |
+                                        ((settings.presOversampling & 0x07) << 2) | BME280_MODE_FORCED);
+    return getMeasurementTimeUs();
+}
+
+BME280_Data BME280_Driver::readForced() {
+    // We know exactly how long the conversion takes, so there's no need to
+    // keep polling isMeasuring() over the bus - just wait it out
+    uint32_t waitUs = triggerForcedMeasurement();
+    if (transport) {
+        transport->delayMs((waitUs + 999) / 1000);  // Round up to whole milliseconds
+    }
+    
+    return readAll();
+}
+
 // === Low-level I2C communication functions ===
-// This is where we're really getting our hands dirty with direct hardware access
+// The actual bus work happens in the transport, here we just keep count
 
 // Read a single byte from a register
+// If the sensor doesn't answer we get 0xFF, like an I2C bus nobody drives:
+// a wrong chip ID or "still busy" status, so the init just retries
 uint8_t BME280_Driver::readRegister(uint8_t reg) {
     uint8_t value;
-    
-    // I2C works by first sending the address of the register we want to read
-    wire->beginTransmission(deviceAddress);
-    wire->write(reg);  // "I want to read from this register"
-    wire->endTransmission();
-    
-    // Then we request one byte from the device
-    wire->requestFrom(deviceAddress, (uint8_t)1);
-    value = wire->read();  // Get the byte
-    
+    readRegisters(reg, &value, 1);
     return value;
 }
 
 // Read multiple bytes from consecutive registers
-void BME280_Driver::readRegisters(uint8_t reg, uint8_t *buffer, uint8_t length) {
-    // Same as above, but we request multiple bytes
-    wire->beginTransmission(deviceAddress);
-    wire->write(reg);  // Start from this register
-    wire->endTransmission();
-    
-    // Ask for 'length' bytes
-    wire->requestFrom(deviceAddress, length);
-    
-    // Read all the bytes into our buffer
-    for (uint8_t i = 0; i < length; i++) {
-        buffer[i] = wire->read();
+// Returns false if the transfer failed (NAK, bus error or no transport);
+// the buffer is then all 0xFF and must not be used
+bool BME280_Driver::readRegisters(uint8_t reg, uint8_t *buffer, uint8_t length) {
+    transactionCount++;
+    lastReadOk = transport && transport->readRegisters(deviceAddress, reg, buffer, length);
+    if (!lastReadOk) {
+        memset(buffer, 0xFF, length);
+        readErrors++;
     }
+    return lastReadOk;
 }
 
 // Write a value to a register
-void BME280_Driver::writeRegister(uint8_t reg, uint8_t value) {
-    wire->beginTransmission(deviceAddress);
-    wire->write(reg);    // "I want to write to this register"
-    wire->write(value);  // "...and this is the value"
-    wire->endTransmission();
-    
-    // This is how we configure the sensor - by writing specific
-    // values to specific registers
+// This is how we configure the sensor - by writing specific
+// values to specific registers
+bool BME280_Driver::writeRegister(uint8_t reg, uint8_t value) {
+    transactionCount++;
+    return transport && transport->writeRegister(deviceAddress, reg, value);
+}
+
+bool BME280_Driver::cachedCalibrationMatches() {
+    // dig_T1..dig_T3 are different on every part, and the image registers
+    // already hold them after power-on, so no reset is needed to read them
+    uint8_t buffer[6];
+    return readRegisters(BME280_REG_DIG_T1, buffer, 6) &&
+           calibData.dig_T1 == (uint16_t)((buffer[1] << 8) | buffer[0]) &&
+           calibData.dig_T2 == (int16_t)((buffer[3] << 8) | buffer[2]) &&
+           calibData.dig_T3 == (int16_t)((buffer[5] << 8) | buffer[4]);
 }
 
-void BME280_Driver::readCalibrationData() {
+bool BME280_Driver::readCalibrationData() {
     uint8_t buffer[24];
     
     // Read temperature and pressure calibration data (registers 0x88-0x9F)
-    readRegisters(BME280_REG_DIG_T1, buffer, 24);
+    if (!readRegisters(BME280_REG_DIG_T1, buffer, 24)) {
+        return false;
+    }
     
     calibData.dig_T1 = (buffer[1] << 8) | buffer[0];
     calibData.dig_T2 = (buffer[3] << 8) | buffer[2];
@@ -197,76 +398,24 @@ void BME280_Driver::readCalibrationData() {
     calibData.dig_P9 = (buffer[23] << 8) | buffer[22];
     
     // Read humidity calibration data (registers are not sequential)
-    calibData.dig_H1 = readRegister(BME280_REG_DIG_H1);
-    
-    readRegisters(BME280_REG_DIG_H2, buffer, 7);
+    if (!readRegisters(BME280_REG_DIG_H1, &calibData.dig_H1, 1) ||
+        !readRegisters(BME280_REG_DIG_H2, buffer, 7)) {
+        return false;
+    }
     calibData.dig_H2 = (buffer[1] << 8) | buffer[0];
     calibData.dig_H3 = buffer[2];
     
     calibData.dig_H4 = (buffer[3] << 4) | (buffer[4] & 0x0F);
     calibData.dig_H5 = (buffer[5] << 4) | (buffer[4] >> 4);
     calibData.dig_H6 = (int8_t)buffer[6];
+    return true;
 }
 
-// Temperature compensation formula from BME280 datasheet
-int32_t BME280_Driver::compensateTemperature(int32_t adcTemp) {
-    int32_t var1, var2, temperature;
-    
-    var1 = ((((adcTemp >> 3) - ((int32_t)calibData.dig_T1 << 1))) * 
-            ((int32_t)calibData.dig_T2)) >> 11;
-            
-    var2 = (((((adcTemp >> 4) - ((int32_t)calibData.dig_T1)) * 
-              ((adcTemp >> 4) - ((int32_t)calibData.dig_T1))) >> 12) * 
-            ((int32_t)calibData.dig_T3)) >> 14;
-            
-    t_fine = var1 + var2;
-    temperature = (t_fine * 5 + 128) >> 8;
-    
-    return temperature;
-}
-
-// Pressure compensation formula from BME280 datasheet
-uint32_t BME280_Driver::compensatePressure(int32_t adcPres) {
-    int64_t var1, var2, p;
-    
-    var1 = ((int64_t)t_fine) - 128000;
-    var2 = var1 * var1 * (int64_t)calibData.dig_P6;
-    var2 = var2 + ((var1 * (int64_t)calibData.dig_P5) << 17);
-    var2 = var2 + (((int64_t)calibData.dig_P4) << 35);
-    var1 = ((var1 * var1 * (int64_t)calibData.dig_P3) >> 8) + 
-           ((var1 * (int64_t)calibData.dig_P2) << 12);
-    var1 = (((((int64_t)1) << 47) + var1)) * ((int64_t)calibData.dig_P1) >> 33;
-    
-    if (var1 == 0) {
-        return 0; // Avoid division by zero
+BME280_FixedData BME280_Driver::readForcedFixed() {
+    uint32_t waitUs = triggerForcedMeasurement();
+    if (transport) {
+        transport->delayMs((waitUs + 999) / 1000);
     }
     
-    p = 1048576 - adcPres;
-    p = (((p << 31) - var2) * 3125) / var1;
-    var1 = (((int64_t)calibData.dig_P9) * (p >> 13) * (p >> 13)) >> 25;
-    var2 = (((int64_t)calibData.dig_P8) * p) >> 19;
-    
-    p = ((p + var1 + var2) >> 8) + (((int64_t)calibData.dig_P7) << 4);
-    return (uint32_t)p;
-}
-
-// Humidity compensation formula from BME280 datasheet
-uint32_t BME280_Driver::compensateHumidity(int32_t adcHum) {
-    int32_t v_x1_u32r;
-    
-    v_x1_u32r = (t_fine - ((int32_t)76800));
-    
-    v_x1_u32r = (((((adcHum << 14) - (((int32_t)calibData.dig_H4) << 20) -
-                   (((int32_t)calibData.dig_H5) * v_x1_u32r)) + ((int32_t)16384)) >> 15) *
-                (((((((v_x1_u32r * ((int32_t)calibData.dig_H6)) >> 10) *
-                   (((v_x1_u32r * ((int32_t)calibData.dig_H3)) >> 11) + ((int32_t)32768))) >> 10) +
-                   ((int32_t)2097152)) * ((int32_t)calibData.dig_H2) + 8192) >> 14));
-    
-    v_x1_u32r = (v_x1_u32r - (((((v_x1_u32r >> 15) * (v_x1_u32r >> 15)) >> 7) * 
-                             ((int32_t)calibData.dig_H1)) >> 4));
-    
-    v_x1_u32r = (v_x1_u32r < 0) ? 0 : v_x1_u32r;
-    v_x1_u32r = (v_x1_u32r > 419430400) ? 419430400 : v_x1_u32r;
-    
-    return (uint32_t)(v_x1_u32r >> 12);
+    return readAllFixed();
 }
@@ -1,8 +1,10 @@
 #ifndef BME280_DRIVER_H
 #define BME280_DRIVER_H
 
-#include <Arduino.h>
-#include <Wire.h>
+#include <stdint.h>
+#include "bme280_transport.h"
+#include "bme280_compensation.h"
+#include "bme280_calibration_cache.h"
 
 // BME280 can have two different I2C addresses depending on how SDO pin is connected
 // Most modules use 0x76 (SDO to GND), but some use 0x77 (SDO to VCC)
@@ -12,6 +14,7 @@
 // These are all the registers we need to interact with the BME280
 // I got these from the datasheet - it's like a map of the sensor's memory
 #define BME280_REG_ID              0xD0  // Chip ID register - should return 0x60
+#define BME280_CHIP_ID             0x60  // What a BME280 answers there (a BMP280 says 0x58)
 #define BME280_REG_RESET           0xE0  // Writing 0xB6 here resets the sensor
 #define BME280_REG_STATUS          0xF3  // Status register - tells us if it's busy
 #define BME280_REG_CTRL_MEAS       0xF4  // Control register for temp & pressure
@@ -50,78 +53,204 @@
 #define BME280_REG_DIG_H5          0xE5  // multiple registers in a weird way
 #define BME280_REG_DIG_H6          0xE7
 
-// Sensor configuration values - keeping these simple for stability
+// Oversampling settings (osrs_t, osrs_p and osrs_h fields)
+// More oversampling means less noise, but each conversion takes longer
+#define BME280_OSR_SKIP            0x00  // Channel disabled
+#define BME280_OSR_X1              0x01
+#define BME280_OSR_X2              0x02
+#define BME280_OSR_X4              0x03
+#define BME280_OSR_X8              0x04
+#define BME280_OSR_X16             0x05
+
+// Sensor modes (bits 1:0 of ctrl_meas)
+#define BME280_MODE_SLEEP          0x00  // No measurements, lowest power
+#define BME280_MODE_FORCED         0x01  // One measurement, then back to sleep
+#define BME280_MODE_NORMAL         0x03  // Continuous measurements with standby in between
+
+// IIR filter coefficient (filter field of config)
+#define BME280_FILTER_OFF          0x00
+#define BME280_FILTER_2            0x01
+#define BME280_FILTER_4            0x02
+#define BME280_FILTER_8            0x03
+#define BME280_FILTER_16           0x04
+
+// Standby time between measurements in normal mode (t_sb field of config)
+#define BME280_STANDBY_0_5_MS      0x00
+#define BME280_STANDBY_62_5_MS     0x01
+#define BME280_STANDBY_125_MS      0x02
+#define BME280_STANDBY_250_MS      0x03
+#define BME280_STANDBY_500_MS      0x04
+#define BME280_STANDBY_1000_MS     0x05
+#define BME280_STANDBY_10_MS       0x06
+#define BME280_STANDBY_20_MS       0x07
+
+// Default sensor configuration used by begin() - keeping these simple for stability
 // You could increase these for more accuracy, but it uses more power
-#define BME280_TEMP_OSR            0x01  // Temperature oversampling x1 (basic accuracy)
-#define BME280_PRES_OSR            0x01  // Pressure oversampling x1
-#define BME280_HUM_OSR             0x01  // Humidity oversampling x1
-#define BME280_MODE                0x03  // Normal mode (continuous readings)
-
-// This structure holds all the calibration coefficients for the BME280
-// Each sensor has unique values that we have to read from its memory
-// We'll use these values in complex formulas from the datasheet
+// They can all be changed at runtime with setSettings()
+#define BME280_TEMP_OSR            BME280_OSR_X1       // Temperature oversampling x1 (basic accuracy)
+#define BME280_PRES_OSR            BME280_OSR_X1       // Pressure oversampling x1
+#define BME280_HUM_OSR             BME280_OSR_X1       // Humidity oversampling x1
+#define BME280_MODE                BME280_MODE_NORMAL  // Normal mode (continuous readings)
+
+// BME280_CalibrationData and the compensation formulas live in bme280_compensation.h
+// so they can be used (and tested) without any Arduino headers
+
+// One complete sample - all three values come from the same burst read,
+// so they always belong to the same measurement cycle
 typedef struct {
-    // Temperature compensation values
-    uint16_t dig_T1;  // Always positive
-    int16_t  dig_T2;  // Can be negative
-    int16_t  dig_T3;  // Can be negative
-    
-    // Pressure compensation values
-    uint16_t dig_P1;  // Always positive
-    int16_t  dig_P2;  // Can be negative
-    int16_t  dig_P3;  // Can be negative
-    int16_t  dig_P4;  // Can be negative
-    int16_t  dig_P5;  // Can be negative
-    int16_t  dig_P6;  // Can be negative
-    int16_t  dig_P7;  // Can be negative
-    int16_t  dig_P8;  // Can be negative
-    int16_t  dig_P9;  // Can be negative
-    
-    // Humidity compensation values
-    uint8_t  dig_H1;  // Always positive
-    int16_t  dig_H2;  // Can be negative
-    uint8_t  dig_H3;  // Always positive
-    int16_t  dig_H4;  // Can be negative, stored weird
-    int16_t  dig_H5;  // Can be negative, stored weird
-    int8_t   dig_H6;  // Can be negative
-} BME280_CalibrationData;
+    float temperature;  // in °C
+    float pressure;     // in hPa
+    float humidity;     // in %RH
+} BME280_Data;
+
+// Timing and retry limits for the non-blocking init (beginAsync()/poll())
+#define BME280_INIT_MAX_ATTEMPTS   5     // Give up after this many failed probes/NVM waits
+#define BME280_INIT_RETRY_MS       100   // Wait between attempts
+#define BME280_STARTUP_MS          2     // Datasheet start-up time after a soft reset
+#define BME280_NVM_POLL_MS         2     // How often to check the NVM copy status bit
+#define BME280_NVM_TIMEOUT_MS      50    // NVM copy should take well under this
+
+// Steps of the init state machine, in the order they happen
+typedef enum {
+    BME280_INIT_IDLE,        // beginAsync() not called yet
+    BME280_INIT_PROBE,       // Checking the chip ID
+    BME280_INIT_WAIT_NVM,    // Reset sent, waiting for the NVM copy to finish
+    BME280_INIT_READ_CALIB,  // Reading the calibration coefficients
+    BME280_INIT_CONFIGURE,   // Writing the oversampling/filter/mode settings
+    BME280_INIT_READY,       // Done - the sensor can be read
+    BME280_INIT_FAILED       // Ran out of attempts
+} BME280_InitState;
+
+// Runtime sensor configuration - one field per register setting
+// Use the BME280_OSR_*, BME280_MODE_*, BME280_FILTER_* and BME280_STANDBY_* values
+typedef struct {
+    uint8_t tempOversampling;  // osrs_t
+    uint8_t presOversampling;  // osrs_p
+    uint8_t humOversampling;   // osrs_h
+    uint8_t filter;            // IIR filter coefficient
+    uint8_t standby;           // Standby time (normal mode only)
+    uint8_t mode;              // Sleep, forced or normal
+} BME280_Settings;
 
 class BME280_Driver {
 private:
-    TwoWire *wire;             // Pointer to the I2C interface
+    BME280_Transport *transport;  // The I2C bus (real TwoWire or the emulator)
     uint8_t deviceAddress;     // I2C address of the BME280 (0x76 or 0x77)
     BME280_CalibrationData calibData;  // Holds all the calibration coefficients
-    int32_t t_fine;            // Temperature fine-resolution value, used in other calculations
+    uint32_t transactionCount; // Number of I2C transactions issued so far (for profiling)
+    BME280_Settings settings;  // Current oversampling/filter/standby/mode settings
+    
+    // Non-blocking init bookkeeping
+    BME280_InitState initState;
+    uint8_t initAttempts;      // Failed attempts so far
+    uint32_t initWaitUntil;    // millis() time before which poll() does nothing
+    uint32_t nvmWaitStart;     // When we started waiting for the NVM copy
+    BME280_CalibrationStore *calibStore;  // Optional calibration cache (may be null)
+    uint8_t calibBus;          // Bus index used as part of the cache key
+    bool calibFromCache;       // True if the last init used cached calibration
+    uint8_t chipId;            // What the probe read from BME280_REG_ID
+    bool lastReadOk;           // Did the last register read get an answer?
+    uint32_t readErrors;       // Reads that failed (NAK, bus error)
+    void initRetry(uint32_t now);  // Count a failure and go back to probing (or give up)
 
     // These are our low-level I2C functions to talk to the sensor
     // I'm implementing these myself instead of using a library
+    // They go through the transport, so the same code runs on the native build
     uint8_t readRegister(uint8_t reg);  // Read a single register
-    void readRegisters(uint8_t reg, uint8_t *buffer, uint8_t length); // Read multiple registers
-    void writeRegister(uint8_t reg, uint8_t value);  // Write to a register
-    void readCalibrationData();  // Read all calibration data from the sensor
-    
-    // These are the complex compensation formulas straight from the BME280 datasheet
-    // They convert raw ADC values to actual temperature, pressure, and humidity
-    int32_t compensateTemperature(int32_t adcTemp);  // Also updates t_fine
-    uint32_t compensatePressure(int32_t adcPres);    // Needs t_fine from temperature
-    uint32_t compensateHumidity(int32_t adcHum);     // Needs t_fine from temperature
+    bool readRegisters(uint8_t reg, uint8_t *buffer, uint8_t length); // Read multiple registers
+    bool writeRegister(uint8_t reg, uint8_t value);  // Write to a register
+    bool readCalibrationData();  // Read all calibration data from the sensor
+    bool cachedCalibrationMatches();  // Is the cached calibration this part's?
 
 public:
-    // Create a new BME280 driver, optionally specifying I2C interface and address
-    BME280_Driver(TwoWire *w = &Wire, uint8_t addr = BME280_ADDRESS_PRIMARY);
+    // Create a new BME280 driver on the given bus transport and address
+    // (BME280_TwoWireTransport on the ESP32, BME280_EmulatedTransport natively)
+    BME280_Driver(BME280_Transport *t = nullptr, uint8_t addr = BME280_ADDRESS_PRIMARY);
     
     // Basic functions to initialize and check the sensor
-    bool begin();         // Initialize the sensor, returns true if found
+    bool begin();         // Initialize the sensor, returns true if found (blocks, but bounded)
+    
+    // Non-blocking version of begin(): beginAsync() starts the init and poll()
+    // advances it by at most one step per call, so it can run from loop()
+    // while the display, WiFi and MQTT come up. Retries are bounded, so a
+    // missing sensor ends in BME280_INIT_FAILED instead of hanging forever
+    void beginAsync();
+    BME280_InitState poll();
+    bool isReady() { return initState == BME280_INIT_READY; }
+    
+    // Optional persistent calibration cache. With a valid cached record the
+    // init skips the reset, NVM wait and calibration read. The record is keyed
+    // by chip ID, bus and address, which is the same for every BME280 in that
+    // spot, so the init re-reads dig_T1..dig_T3 (one 6-byte read) and only
+    // trusts the cache if they match - a replaced sensor gets a cold boot
+    // Must be set before begin()/beginAsync(). With several I2C buses, pass the
+    // bus index so sensors at the same address on different buses don't collide
+    void setCalibrationStore(BME280_CalibrationStore *store, uint8_t bus = 0) {
+        calibStore = store;
+        calibBus = bus;
+    }
+    bool usedCachedCalibration() { return calibFromCache; }
+    BME280_InitState getInitState() { return initState; }
+    
     void reset();         // Soft-reset the sensor
     uint8_t getChipID();  // Should return 0x60 if it's a BME280
     
     // The main functions you'll use to get sensor readings
+    // Pressure and humidity need temperature (t_fine) for compensation, so they
+    // always read it in the same burst - one I2C transaction each, no stale values
     float readTemperature(); // Get temperature in °C
     float readPressure();    // Get pressure in hPa (divide by 100 from Pa)
     float readHumidity();    // Get relative humidity in %
     
+    // Read temperature, pressure and humidity in a single 8-byte burst (0xF7-0xFE)
+    // This is one I2C transaction instead of three, and the sensor's shadow
+    // registers guarantee all three values are from the same measurement
+    BME280_Data readAll();
+    
+    // Same burst, but the results stay integers: hundredths of °C, hPa and %RH
+    // This is what the firmware publishes and displays - no float anywhere
+    BME280_FixedData readAllFixed();
+    
+    // Did the last read get an answer from the sensor? If not, the values
+    // above are NAN (or zero for the fixed-point ones) and must not be used
+    bool readOk() { return lastReadOk; }
+    uint32_t getReadErrors() { return readErrors; }
+    
+    // Count of I2C transactions (register write + read pairs count as one)
+    // Handy for checking how much bus time each sample really costs
+    uint32_t getTransactionCount() { return transactionCount; }
+    void resetTransactionCount() { transactionCount = 0; }
+    
+    // Where this driver talks to
+    BME280_Transport *getTransport() { return transport; }
+    uint8_t getAddress() { return deviceAddress; }
+    
+    // The calibration coefficients read in begin(), for use with bme280_compensation.h
+    const BME280_CalibrationData &getCalibrationData() { return calibData; }
+    
     // Check if the sensor is currently taking a measurement
     bool isMeasuring();  // Returns true if a measurement is in progress
+    
+    // Change oversampling, IIR filter, standby time and mode at runtime
+    // In forced mode the sensor is left asleep until triggerForcedMeasurement()
+    void setSettings(const BME280_Settings &newSettings);
+    const BME280_Settings &getSettings() { return settings; }
+    
+    // Worst-case conversion time in microseconds for the given settings
+    // (datasheet section 9.1: 1.25 ms + 2.3 ms per oversample, plus 0.575 ms
+    // for each of pressure and humidity when enabled)
+    static uint32_t measurementTimeUs(const BME280_Settings &s);
+    uint32_t getMeasurementTimeUs() { return measurementTimeUs(settings); }
+    
+    // Forced mode: start a single conversion and return how long it will take (us)
+    // The sensor goes back to sleep on its own once the conversion is done
+    uint32_t triggerForcedMeasurement();
+    
+    // Trigger a forced conversion, wait exactly the predicted time with the
+    // transport's delay (which yields to other tasks on the ESP32) and then
+    // burst-read the result
+    BME280_Data readForced();
+    BME280_FixedData readForcedFixed();  // Same, with readAllFixed()
 };
 
 #endif // BME280_DRIVER_H
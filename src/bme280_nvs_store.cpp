@@ -0,0 +1,36 @@
+#include "bme280_nvs_store.h"
+
+// Build the NVS key for a bus/address, e.g. "cal_76" or "cal1_77"
+static void makeKey(uint8_t bus, uint8_t address, char *key, size_t size) {
+    if (bus == 0) {
+        snprintf(key, size, "cal_%02x", address);
+    } else {
+        snprintf(key, size, "cal%u_%02x", bus, address);
+    }
+}
+
+bool BME280_NvsCalibrationStore::readRecord(uint8_t bus, uint8_t address, BME280_CalibrationRecord &record) {
+    char key[12];
+    makeKey(bus, address, key, sizeof(key));
+
+    if (!prefs.begin("bme280", true)) {  // Read-only
+        return false;
+    }
+    size_t length = prefs.getBytes(key, &record, sizeof(record));
+    prefs.end();
+
+    return length == sizeof(record);
+}
+
+bool BME280_NvsCalibrationStore::writeRecord(uint8_t bus, uint8_t address, const BME280_CalibrationRecord &record) {
+    char key[12];
+    makeKey(bus, address, key, sizeof(key));
+
+    if (!prefs.begin("bme280", false)) {
+        return false;
+    }
+    size_t length = prefs.putBytes(key, &record, sizeof(record));
+    prefs.end();
+
+    return length == sizeof(record);
+}
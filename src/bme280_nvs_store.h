@@ -0,0 +1,20 @@
+#ifndef BME280_NVS_STORE_H
+#define BME280_NVS_STORE_H
+
+#include <Arduino.h>
+#include <Preferences.h>
+#include "bme280_calibration_cache.h"
+
+// ESP32 calibration store backed by NVS (the Preferences library)
+// Each bus/address gets its own key ("cal_76" on bus 0, "cal1_77" on bus 1...)
+// in the "bme280" namespace
+class BME280_NvsCalibrationStore : public BME280_CalibrationStore {
+protected:
+    bool readRecord(uint8_t bus, uint8_t address, BME280_CalibrationRecord &record) override;
+    bool writeRecord(uint8_t bus, uint8_t address, const BME280_CalibrationRecord &record) override;
+
+private:
+    Preferences prefs;
+};
+
+#endif // BME280_NVS_STORE_H
@@ -0,0 +1,39 @@
+#include "bme280_twowire_transport.h"
+
+// === Low-level I2C communication functions ===
+// This is where we're really getting our hands dirty with direct hardware access
+
+// Write a value to a register
+bool BME280_TwoWireTransport::writeRegister(uint8_t address, uint8_t reg, uint8_t value) {
+    wire->beginTransmission(address);
+    wire->write(reg);    // "I want to write to this register"
+    wire->write(value);  // "...and this is the value"
+    return wire->endTransmission() == 0;
+}
+
+// Read multiple bytes from consecutive registers
+bool BME280_TwoWireTransport::readRegisters(uint8_t address, uint8_t reg, uint8_t *buffer, uint8_t length) {
+    // I2C works by first sending the address of the register we want to read
+    wire->beginTransmission(address);
+    wire->write(reg);  // Start from this register
+    if (wire->endTransmission(false) != 0) {  // Repeated start, keep the bus
+        return false;
+    }
+
+    // Ask for 'length' bytes
+    if (wire->requestFrom(address, length) != length) {
+        return false;
+    }
+
+    // Read all the bytes into our buffer
+    for (uint8_t i = 0; i < length; i++) {
+        buffer[i] = wire->read();
+    }
+    return true;
+}
+
+bool BME280_TwoWireTransport::probe(uint8_t address) {
+    // An address-only write: the device ACKs (returns 0) if it's there
+    wire->beginTransmission(address);
+    return wire->endTransmission() == 0;
+}
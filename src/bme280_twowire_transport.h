@@ -0,0 +1,27 @@
+#ifndef BME280_TWOWIRE_TRANSPORT_H
+#define BME280_TWOWIRE_TRANSPORT_H
+
+#include <Arduino.h>
+#include <Wire.h>
+#include "bme280_transport.h"
+
+// The real thing: BME280 transport on top of an Arduino TwoWire bus
+// One of these per I2C bus, shared by every sensor on that bus
+class BME280_TwoWireTransport : public BME280_Transport {
+private:
+    TwoWire *wire;  // Pointer to the I2C interface
+
+public:
+    explicit BME280_TwoWireTransport(TwoWire *w = &Wire) : wire(w) {}
+
+    bool writeRegister(uint8_t address, uint8_t reg, uint8_t value) override;
+    bool readRegisters(uint8_t address, uint8_t reg, uint8_t *buffer, uint8_t length) override;
+    bool probe(uint8_t address) override;
+
+    uint32_t millis() override { return ::millis(); }
+    void delayMs(uint32_t ms) override { delay(ms); }  // Yields to other tasks on the ESP32
+
+    TwoWire *getWire() { return wire; }
+};
+
+#endif // BME280_TWOWIRE_TRANSPORT_H
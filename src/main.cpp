@@ -2,12 +2,33 @@
 #include <PubSubClient.h>
 #include <Wire.h>
 #include <TFT_eSPI.h>
+#include <LittleFS.h>
+#include <atomic>
 #include "bme280_driver.h"
+#include "bme280_bus_manager.h"
+#include "bme280_twowire_transport.h"
+#include "bme280_nvs_store.h"
+#include "fixed_format.h"
+#include "sample_buffer.h"
+#include "batch_publisher.h"
+#include "payload_codec.h"
+#include "deadband_filter.h"
+#include "reconnect_backoff.h"
+#include "command_table.h"
+#include "task_scheduler.h"
+#include "running_stats.h"
+#include "sensor_data.h"
+#include "spsc_queue.h"
+#include "display_widgets.h"
+#include "sprite_field.h"
+#include "screen_layout.h"
 
 // Hardware pins - I'm using the default I2C pins on ESP32
 // You can change these if your wiring is different
 #define SDA_PIN 21  // I2C data line for BME280 sensor
 #define SCL_PIN 22  // I2C clock line for BME280 sensor
+#define SDA2_PIN 25 // Second I2C bus for extra sensors (optional)
+#define SCL2_PIN 26
 #define LED_PIN 2   // This is the built-in LED on most ESP32 boards
 
 // WiFi stuff - don't forget to put your actual WiFi details here
@@ -20,47 +41,254 @@ const char* password = "YourWiFiPassword";
 const char* mqtt_server = "broker.hivemq.com";
 const int mqtt_port = 1883;
 const char* mqtt_client_id = "ESP32_Sensor_Client";
-const char* mqtt_topic_publish = "sensor/bme280/data";
+const char* mqtt_topic_publish = "sensor/bme280/data";  // + "/json", "/packed" or "/cbor"
 const char* mqtt_topic_subscribe = "sensor/bme280/commands";
+const char* mqtt_topic_aggregate = "sensor/bme280/aggregate";  // Mean/min/max/stddev per publish window
+const char* mqtt_topic_status = "sensor/bme280/status";  // Connection counters, sent on every (re)connect
+
+// Reconnecting never blocks for long: the TCP connect and the wait for the
+// broker's CONNACK both have short timeouts, and they run as separate steps
+// of a state machine (serviceMQTT()) so sampling happens in between
+#define MQTT_TCP_TIMEOUT_MS        1500  // TCP connect timeout
+#define MQTT_SOCKET_TIMEOUT_S      2     // PubSubClient's wait for CONNACK etc.
+
+// Samples are sent in batches: one message per sensor every
+// MQTT_BATCH_SAMPLES samples or MQTT_BATCH_AGE_MS, whichever comes first
+// (see batch_publisher.h). Set MQTT_BATCH_SAMPLES to 1 for one message per sample
+#define MQTT_BATCH_SAMPLES         BATCH_DEFAULT_SAMPLES
+#define MQTT_BATCH_AGE_MS          BATCH_DEFAULT_AGE_MS
+
+// Payload encoding: PAYLOAD_JSON, PAYLOAD_PACKED or PAYLOAD_CBOR (payload_codec.h)
+// The format name is appended to the topic so subscribers know how to decode it
+#define MQTT_PAYLOAD_FORMAT        PAYLOAD_JSON
+
+// Samples taken while MQTT is down are kept and sent after reconnecting,
+// one full batch at a time so we don't flood the link (or the broker)
+#define BACKLOG_DRAIN_BATCH        BATCH_MAX_SAMPLES  // Samples per backlog message
+#define BACKLOG_DRAIN_INTERVAL_MS  500  // Time between backlog messages
+#define BACKLOG_SPILL_TO_FLASH     1    // Spill to LittleFS when the RAM buffer is full
+
+// The work is split over the ESP32's two cores, so a slow MQTT call or a
+// TCP stall can't hold up sampling or the display:
+// - Sensor core (1, where loop() runs): sampling and the display
+// - Network core (0, next to the WiFi stack): MQTT, publishing, backlog
+// Readings go from one to the other through a lock-free queue (spsc_queue.h),
+// and commands that change something on the sensor side are passed back
+// through a second small queue
+#define SENSOR_CORE                1     // Where Arduino's loop() runs (set by the core, not here)
+#define NETWORK_CORE               0
+static_assert(SENSOR_CORE != NETWORK_CORE, "the network task needs the core loop() isn't on");
+#define NETWORK_TASK_STACK         8192  // Bytes - PubSubClient, the payload buffers and printf
+#define NETWORK_TASK_PRIORITY      1     // Same as loop()
+#define SAMPLE_QUEUE_LENGTH        64    // Readings in flight (6 s at 10 Hz with one sensor)
+#define CONTROL_QUEUE_LENGTH       8     // Commands for the sensor core in flight
+
+// Each core runs its tasks with its own scheduler, each with its own period
+// (see task_scheduler.h). "SET_PERIOD <task> <ms>" changes them while
+// running, e.g. sample at 10 Hz and publish every 10 s
+#define SAMPLE_PERIOD_MS           2000  // Sensor core: read the sensors
+#define DISPLAY_PERIOD_MS          2000  // Sensor core: redraw the status and the readings
+#define PUBLISH_PERIOD_MS          2000  // Network core: send the window aggregates to the batcher
+#define KEEPALIVE_PERIOD_MS        10    // Network core: MQTT messages, reconnect steps, batch flushes, backlog
+#define MIN_TASK_PERIOD_MS         10
+#define MAX_TASK_PERIOD_MS         1800000  // 30 minutes
+
+// Parts of the screen updateDisplay() can redraw on their own, so a command
+// or a new reading only repaints what it actually changed
+#define REGION_STATUS    0x01  // MQTT connection line
+#define REGION_READINGS  0x02  // Temperature, humidity and pressure
+#define REGION_LED       0x04  // LED status line
+#define REGION_BUTTON    0x08  // Reset button
+#define REGION_ALL       0x0F
+#define REGION_SCREEN    0x80  // Clear and redraw everything, title included
+
+// The three readings are drawn into RAM and sent to the panel by DMA, so
+// loop() doesn't wait for the SPI transfer (see sprite_field.h). Set to 0 to
+// draw them character by character like the other text, e.g. to compare the
+// loop() stall times that TASK_STATS prints
+#define DISPLAY_USE_DMA  1
 
 // Creating the objects we need for the project
 TFT_eSPI tft = TFT_eSPI();  // This handles our display
-BME280_Driver bme280;       // My custom sensor driver (no high-level libraries!)
+BME280_TwoWireTransport i2cBus0(&Wire);   // The BME280 driver talks to I2C through these
+BME280_TwoWireTransport i2cBus1(&Wire1);
+BME280_BusManager bme280Bus;  // Finds and samples all BME280s (my custom driver, no high-level libraries!)
+BME280_NvsCalibrationStore calibStore;  // Remembers the calibration between boots
 WiFiClient espClient;       // Handles WiFi connection
 PubSubClient mqttClient(espClient); // Handles MQTT messaging
+DeadbandFilter deadbands[BME280_MAX_SENSORS];  // Report-by-exception, one per sensor
+SampleBatcher batches[BME280_MAX_SENSORS];  // Samples waiting to go out, one batch per sensor
+SampleBatcher backlogBatch(BACKLOG_DRAIN_BATCH, 0);  // The backlog message being sent
+SampleBuffer backlog;       // Samples waiting for MQTT to come back (preallocated)
+FileSampleSpillStore backlogSpill("/littlefs/backlog.bin");  // Overflow for the backlog
+CommandTable commands;      // MQTT commands, registered in setupCommands()
+uint32_t schedulerClock() { return micros(); }
+TaskScheduler sensorScheduler(schedulerClock);   // Sensor core tasks, run from loop()
+TaskScheduler networkScheduler(schedulerClock);  // Network core tasks, run from networkTask()
+
+// Things the network core asks the sensor core to do (commands arrive on the
+// network side, but only the sensor core touches the display and its tasks)
+enum ControlType : uint8_t {
+  CONTROL_REDRAW,     // value = REGION_* bits
+  CONTROL_PERIOD      // task = index in sensorScheduler, value = period in ms
+};
+typedef struct {
+  ControlType type;
+  uint8_t task;
+  uint32_t value;
+} ControlMessage;
+
+SpscQueue<SensorSample, SAMPLE_QUEUE_LENGTH> sampleQueue;       // Sensor core -> network core
+SpscQueue<ControlMessage, CONTROL_QUEUE_LENGTH> controlQueue;   // Network core -> sensor core
+
+// TASK_STATS for the sensor core's tasks: the network core raises the
+// request, the sensor core copies its numbers into sensorTaskStats and
+// raises the answer, and the network core publishes them
+std::atomic<bool> statsRequested(false);
+std::atomic<bool> statsReady(false);
+TaskStats sensorTaskStats[SCHEDULER_MAX_TASKS];
+
+// Where the MQTT connection is at - serviceMQTT() moves it along
+enum MqttState {
+  MQTT_WAITING,       // Disconnected, waiting for the backoff timer (and WiFi)
+  MQTT_TCP_CONNECT,   // Next step: open the TCP connection
+  MQTT_SESSION,       // Next step: MQTT CONNECT over the open socket
+  MQTT_CONNECTED
+};
+MqttState mqttState = MQTT_WAITING;
+ReconnectBackoff mqttBackoff;           // Exponential backoff with full jitter
+unsigned long mqttConnectStart = 0;     // When the current attempt began
 
 // Some global variables to track the system state
-bool ledState = false;          // Is the LED on or off?
+// (the atomic ones are written on one core and read on the other)
+std::atomic<bool> ledState(false);      // Is the LED on or off?
+std::atomic<bool> mqttOnline(false);    // Connected to the broker? For the display
 bool displayCleared = false;    // Has the display been cleared?
-unsigned long lastUpdateTime = 0;       // When did we last update the display?
-const unsigned long updateInterval = 2000; // Update every 2 seconds (not too fast, not too slow)
+unsigned long lastDrainTime = 0;        // When did we last send a batch of the backlog?
+char mqttDataTopic[MQTT_TOPIC_MAX_BYTES + 1];  // mqtt_topic_publish + "/" + format name
+int primarySensor = -1;                 // Sensor core: index of the sensor shown on the display
+int backlogSensor = -1;                 // Network core: the same sensor, whose samples go to the backlog
 
-// A simple struct to hold all the sensor readings in one place
-// Makes the code cleaner than having separate variables
-struct SensorData {
-  float temperature;  // in Celsius
-  float humidity;     // in % relative humidity
-  float pressure;     // in hPa (hectopascals)
-} sensorData;
+// The primary sensor's latest reading, for the display (sensor core)
+// SensorData is in sensor_data.h: hundredths as integers, no floats
+SensorData sensorData;
+
+// Everything one sensor measured since the last publish (network core).
+// When sampling runs faster than publishing, the publish task sends these
+// summaries instead of whatever the last reading happened to be. Constant
+// memory no matter how many samples go in (see running_stats.h)
+struct SensorAggregate {
+  RunningStats temperature;
+  RunningStats humidity;
+  RunningStats pressure;
+  uint32_t firstTime;   // millis() of the first and the last sample in the window
+  uint32_t lastTime;
+  uint8_t bus;          // Where the sensor is, for the payload header
+  uint8_t address;
+  
+  void add(const SensorSample &sample) {
+    if (temperature.count() == 0) {
+      firstTime = sample.timestamp;
+    }
+    lastTime = sample.timestamp;
+    bus = sample.bus;
+    address = sample.address;
+    temperature.add(sample.data.temperature);
+    humidity.add(sample.data.humidity);
+    pressure.add(sample.data.pressure);
+  }
+  
+  uint32_t count() const { return temperature.count(); }
+  
+  void reset() {
+    temperature.reset();
+    humidity.reset();
+    pressure.reset();
+  }
+} aggregates[BME280_MAX_SENSORS];
+
+// Window summaries are live-only: while MQTT is down only the mean goes to
+// the backlog, and the summary is counted here and reported in the status
+// message ("summaries_dropped"). Network core only
+uint32_t summariesDropped = 0;
 
 // Display colors for our UI - keeping it simple but with good contrast
-// These make the UI look more professional than just using default colors
-#define BACKGROUND TFT_BLACK    // Black background is easy on the eyes
-#define TEXT_COLOR TFT_WHITE    // White text for good contrast
-#define STATUS_COLOR TFT_GREEN  // Green for "good/connected" status
-#define ERROR_COLOR TFT_RED     // Red for errors or "disconnected" status
-#define TITLE_COLOR TFT_CYAN    // Cyan for titles and important readings
+// The values, like all the positions and strings, are in screen_layout.h,
+// which the simulator's golden-image tests draw from too
+#define BACKGROUND SCREEN_BACKGROUND  // Black background is easy on the eyes
+#define TEXT_COLOR SCREEN_TEXT        // White text for good contrast
+#define STATUS_COLOR SCREEN_STATUS    // Green for "good/connected" status
+#define ERROR_COLOR SCREEN_ERROR      // Red for errors or "disconnected" status
+#define TITLE_COLOR SCREEN_TITLE      // Cyan for titles and important readings
+
+// Everything on the screen that changes after boot is a text widget that
+// remembers what it shows, so a refresh only redraws the characters that
+// actually changed (see display_widgets.h). Sensor core only. Each
+// reading's label comes right before its value, in screen_layout.h's order
+enum WidgetId {
+  WIDGET_STATUS,          // "MQTT: Connected"
+  WIDGET_TEMP_LABEL,
+  WIDGET_TEMP,
+  WIDGET_HUMID_LABEL,
+  WIDGET_HUMID,
+  WIDGET_PRES_LABEL,
+  WIDGET_PRES,
+  WIDGET_LED_LABEL,
+  WIDGET_LED,
+  WIDGET_COUNT
+};
+TextWidget widgets[WIDGET_COUNT];
+WidgetRenderer<TFT_eSPI> displayRenderer(tft, BACKGROUND, schedulerClock);
+
+// The readings as sprites (used when DISPLAY_USE_DMA is 1)
+enum ValueField { FIELD_TEMP, FIELD_HUMID, FIELD_PRES, FIELD_COUNT };
+SpriteField valueFields[FIELD_COUNT];
+SpriteStats spriteStats;          // What the sprites cost, next to displayRenderer.total
+bool displayDmaOpen = false;      // A DMA transfer may be running and we hold the SPI bus
+
+// How long one pass through loop() takes - the longest is how long sampling
+// can be held up. Printed and reset with TASK_STATS
+uint32_t loopPasses = 0;
+uint32_t loopMaxUs = 0;
+uint64_t loopTotalUs = 0;
 
 // --- Function prototypes ---
 void setupWiFi();
 void setupMQTT();
 void setupDisplay();
 void setupBME280();
+void serviceBME280();
 void readSensorData();
-void updateDisplay();
+void updateDisplay(uint8_t regions = REGION_ALL);
+void showValue(uint8_t field, uint8_t widget, int32_t centi, const char* unit);
+void pumpValueFields();
+void finishDisplayWrites();
 void publishSensorData();
+void flushBatches();
+bool publishBatch(uint8_t index);
+bool publishAggregate(uint8_t index);
+void drainBacklog();
+void setupBacklog();
+void setupCommands();
+void setupTasks();
+void networkTask(void* parameter);
+void serviceControlQueue();
+void collectSamples();
+void refreshDisplay();
+void serviceConnection();
+void publishTaskStats(const char* name, uint32_t periodMs, const TaskStats &stats);
+bool handleResetCommand(const char* args);
+bool handleLedOnCommand(const char* args);
+bool handleLedOffCommand(const char* args);
+bool handleIntervalCommand(const char* args);
+bool handlePeriodCommand(const char* args);
+bool handleTaskStatsCommand(const char* args);
+bool handleDeadbandCommand(const char* args);
+bool handleHeartbeatCommand(const char* args);
 void handleMQTTCallback(char* topic, byte* payload, unsigned int length);
-void reconnectMQTT();
+void serviceMQTT();
+void onMQTTConnected();
+void publishConnectionStats();
 void drawButton(int x, int y, int w, int h, String label);
 
 void setup() {
@@ -72,53 +300,189 @@ void setup() {
   pinMode(LED_PIN, OUTPUT);
   digitalWrite(LED_PIN, LOW);  // Start with LED off
   
-  // Start the I2C bus for communicating with the BME280 sensor
+  // Start the I2C buses for communicating with the BME280 sensors
   Wire.begin(SDA_PIN, SCL_PIN);
+  Wire1.begin(SDA2_PIN, SCL2_PIN);
   
-  // Initialize all our components one by one
+  // Initialize all our components
+  // The sensor init runs in the background (serviceBME280() advances it),
+  // so it doesn't hold up WiFi and MQTT
   setupDisplay();  // First the display so we can show progress
-  setupBME280();   // Then the sensor
+  setupBME280();   // Start the sensor init
+  for (uint8_t i = 0; i < BME280_MAX_SENSORS; i++) {
+    batches[i].setPolicy(MQTT_BATCH_SAMPLES, MQTT_BATCH_AGE_MS);
+  }
+  setupBacklog();  // Store-and-forward buffer for when MQTT is down
+  setupCommands(); // What we answer to on the command topic
+  setupTasks();    // What each core runs, and how often
   setupWiFi();     // Connect to WiFi
   setupMQTT();     // Connect to MQTT broker
   
-  // Show initial sensor readings on the display
-  readSensorData();
+  // Show the initial screen - readings appear once the sensor is ready
   updateDisplay();
+  
+  // From here on the network side runs on its own core. setup() runs in the
+  // loop() task, so this is the sensor core - if the Arduino core was built
+  // to run it elsewhere, both sides would share a core
+  if (xPortGetCoreID() != SENSOR_CORE) {
+    Serial.printf("Warning: loop() is on core %d, expected %d\n", xPortGetCoreID(), SENSOR_CORE);
+  }
+  xTaskCreatePinnedToCore(networkTask, "network", NETWORK_TASK_STACK, nullptr,
+                          NETWORK_TASK_PRIORITY, nullptr, NETWORK_CORE);
 }
 
+// The sensor core: sampling and the display
 void loop() {
-  // Always check if we're still connected to MQTT
-  // If not, try to reconnect (doesn't block if WiFi is down)
-  if (!mqttClient.connected()) {
-    reconnectMQTT();
+  uint32_t passStart = micros();
+  
+  // Keep the sensor init moving (does nothing once it's finished)
+  serviceBME280();
+  
+  // Do what the network core asked for (redraws, period changes)
+  serviceControlQueue();
+  
+  // Run whatever is due (see setupTasks()). Nothing in here waits for the
+  // network - readings are queued for the other core and we move on
+  sensorScheduler.run();
+  
+  // Send the next value field to the panel once the last one is through
+  pumpValueFields();
+  
+  // Hand over our task numbers if TASK_STATS asked for them
+  if (statsRequested.exchange(false)) {
+    for (uint8_t i = 0; i < sensorScheduler.size(); i++) {
+      sensorTaskStats[i] = sensorScheduler.stats(i);
+      sensorScheduler.resetStats(i);
+    }
+    const FrameStats &frames = displayRenderer.total;
+    Serial.printf("Display: %lu frames, %lu glyphs, %lu bytes to the panel, %lu us drawing\n",
+                  (unsigned long)frames.frames, (unsigned long)frames.glyphs,
+                  (unsigned long)frames.bytes, (unsigned long)frames.drawUs);
+    Serial.printf("Value sprites: %lu rendered in %lu us, %lu sent (%lu bytes by DMA) in %lu us\n",
+                  (unsigned long)spriteStats.renders, (unsigned long)spriteStats.renderUs,
+                  (unsigned long)spriteStats.pushes, (unsigned long)spriteStats.bytes,
+                  (unsigned long)spriteStats.pushUs);
+    Serial.printf("loop(): %lu passes, longest %lu us, average %lu us\n", (unsigned long)loopPasses,
+                  (unsigned long)loopMaxUs, (unsigned long)(loopPasses ? loopTotalUs / loopPasses : 0));
+    displayRenderer.resetStats();
+    memset(&spriteStats, 0, sizeof(spriteStats));
+    loopPasses = 0;
+    loopMaxUs = 0;
+    loopTotalUs = 0;
+    statsReady.store(true, std::memory_order_release);
+  }
+  
+  uint32_t passUs = micros() - passStart;
+  loopPasses++;
+  loopTotalUs += passUs;
+  if (passUs > loopMaxUs) {
+    loopMaxUs = passUs;
+  }
+}
+
+// The network core: MQTT, publishing and the backlog
+void networkTask(void* parameter) {
+  for (;;) {
+    networkScheduler.run();
+    vTaskDelay(1);  // Let the idle task (and its watchdog) run on this core
   }
-  mqttClient.loop();  // Process any incoming MQTT messages
+}
+
+void setupTasks() {
+  // Order matters a little: when both are due in the same pass, a fresh
+  // sample is taken before it's drawn
+  bool ok = sensorScheduler.add("sample", readSensorData, SAMPLE_PERIOD_MS) >= 0 &&
+            sensorScheduler.add("display", refreshDisplay, DISPLAY_PERIOD_MS) >= 0 &&
+            networkScheduler.add("publish", publishSensorData, PUBLISH_PERIOD_MS) >= 0 &&
+            networkScheduler.add("keepalive", serviceConnection, KEEPALIVE_PERIOD_MS) >= 0;
+  if (!ok) {
+    Serial.println("Task table full!");
+  }
+}
+
+// Sensor core: carry out what the network core's command handlers asked for
+void serviceControlQueue() {
+  ControlMessage message;
+  while (controlQueue.pop(message)) {
+    if (message.type == CONTROL_PERIOD) {
+      sensorScheduler.setPeriod(message.task, message.value);
+      continue;
+    }
+    uint8_t regions = (uint8_t)message.value;
+    if (regions & REGION_SCREEN) {
+      finishDisplayWrites();
+      tft.fillScreen(BACKGROUND);
+      setupDisplay();
+    }
+    if (regions & REGION_ALL) {
+      updateDisplay(regions);
+    }
+  }
+}
+
+// Network core: move the queued readings into the per-sensor aggregates
+void collectSamples() {
+  SensorSample sample;
+  while (sampleQueue.pop(sample)) {
+    if (sample.sensor >= BME280_MAX_SENSORS) {
+      continue;
+    }
+    aggregates[sample.sensor].add(sample);
+    if (sample.primary) {
+      backlogSensor = sample.sensor;
+    }
+  }
+}
+
+// Only the parts that change by themselves - commands redraw the rest
+void refreshDisplay() {
+  updateDisplay(REGION_STATUS | REGION_READINGS);
+}
+
+void serviceConnection() {
+  // Keep the MQTT connection going: processes incoming messages when
+  // connected, otherwise takes at most one short reconnect step
+  serviceMQTT();
+  mqttOnline.store(mqttClient.connected());
+  collectSamples();   // Keep the queue from filling up between publishes
+  flushBatches();     // Send any batch whose oldest sample is old enough
+  drainBacklog();     // Catch up on samples taken while we were offline
   
-  // Time to update our readings? We use millis() instead of delay()
-  // so the ESP32 can still process MQTT messages between updates
-  unsigned long currentTime = millis();
-  if (currentTime - lastUpdateTime >= updateInterval) {
-    readSensorData();     // Get fresh sensor readings
-    updateDisplay();      // Update the display with new values
-    publishSensorData();  // Send the data to MQTT broker
-    lastUpdateTime = currentTime;  // Reset the timer
+  // The sensor core's answer to TASK_STATS
+  if (statsReady.exchange(false, std::memory_order_acquire)) {
+    for (uint8_t i = 0; i < sensorScheduler.size(); i++) {
+      publishTaskStats(sensorScheduler.name(i), sensorScheduler.periodMs(i), sensorTaskStats[i]);
+    }
   }
 }
 
 void setupWiFi() {
-  tft.fillRect(0, 20, 240, 40, BACKGROUND);
+  tft.fillRect(0, SCREEN_WIFI_BAND_Y, SCREEN_WIDTH, SCREEN_WIFI_BAND_HEIGHT, BACKGROUND);
   tft.setTextColor(TEXT_COLOR, BACKGROUND);
-  tft.setCursor(10, 30);
-  tft.print("Connecting to WiFi...");
+  tft.setCursor(SCREEN_MARGIN, SCREEN_WIFI_Y);
+  tft.print(SCREEN_WIFI_CONNECTING);
+  // Where the progress dots go. serviceBME280() prints the sensor status
+  // further down in the meantime, which moves the cursor and changes the
+  // text color, so every dot puts them back first
+  int16_t dotX = tft.getCursorX();
+  int16_t dotY = tft.getCursorY();
   
   Serial.printf("Connecting to WiFi: %s\n", ssid);
   WiFi.begin(ssid, password);
   
   int attempts = 0;
   while (WiFi.status() != WL_CONNECTED && attempts < 20) {
-    delay(500);
+    // Let the sensor init make progress while we wait for WiFi
+    for (int i = 0; i < 50; i++) {
+      serviceBME280();
+      delay(10);
+    }
     Serial.print(".");
-    tft.print(".");
+    tft.setTextColor(TEXT_COLOR, BACKGROUND);
+    tft.setCursor(dotX, dotY);
+    tft.print(SCREEN_WIFI_DOT);
+    dotX = tft.getCursorX();
+    dotY = tft.getCursorY();
     attempts++;
   }
   
@@ -127,25 +491,29 @@ void setupWiFi() {
     Serial.println("IP address: ");
     Serial.println(WiFi.localIP());
     
-    tft.fillRect(0, 20, 240, 40, BACKGROUND);
-    tft.setCursor(10, 30);
+    tft.fillRect(0, SCREEN_WIFI_BAND_Y, SCREEN_WIDTH, SCREEN_WIFI_BAND_HEIGHT, BACKGROUND);
+    tft.setCursor(SCREEN_MARGIN, SCREEN_WIFI_Y);
     tft.setTextColor(STATUS_COLOR, BACKGROUND);
-    tft.print("WiFi: Connected");
-    tft.setCursor(10, 50);
+    tft.print(SCREEN_WIFI_CONNECTED);
+    tft.setCursor(SCREEN_MARGIN, SCREEN_WIFI_IP_Y);
     tft.print(WiFi.localIP().toString());
   } else {
     Serial.println("\nWiFi connection failed!");
     
-    tft.fillRect(0, 20, 240, 40, BACKGROUND);
-    tft.setCursor(10, 30);
+    tft.fillRect(0, SCREEN_WIFI_BAND_Y, SCREEN_WIDTH, SCREEN_WIFI_BAND_HEIGHT, BACKGROUND);
+    tft.setCursor(SCREEN_MARGIN, SCREEN_WIFI_Y);
     tft.setTextColor(ERROR_COLOR, BACKGROUND);
-    tft.print("WiFi: Failed!");
+    tft.print(SCREEN_WIFI_FAILED);
   }
-  delay(1000);
 }
 
 void setupMQTT() {
+  mqttClient.setSocketTimeout(MQTT_SOCKET_TIMEOUT_S);  // Default is 15 s, way too long to stall
+  mqttBackoff.seed(esp_random());  // Every device gets its own jitter
+  snprintf(mqttDataTopic, sizeof(mqttDataTopic), "%s/%s",
+           mqtt_topic_publish, payloadFormatName(MQTT_PAYLOAD_FORMAT));
   mqttClient.setServer(mqtt_server, mqtt_port);
+  mqttClient.setBufferSize(MQTT_PACKET_BUFFER_BYTES);  // A full batch plus topic and header (payload_codec.h)
   mqttClient.setCallback(handleMQTTCallback);
 }
 
@@ -153,167 +521,751 @@ void setupDisplay() {
   // Initialize the display
   tft.init();
   tft.setRotation(0); // Portrait orientation
+#if DISPLAY_USE_DMA
+  tft.initDMA();      // Does nothing if it's already set up (RESET calls us again)
+#endif
   tft.fillScreen(BACKGROUND);
   
   // Draw title
   tft.setTextSize(2);
   tft.setTextColor(TITLE_COLOR, BACKGROUND);
-  tft.setCursor(10, 5);
-  tft.println("BME280 Sensor");
+  tft.setCursor(SCREEN_MARGIN, SCREEN_TITLE_Y);
+  tft.println(SCREEN_TITLE_TEXT);
   
   // Draw line separator
-  tft.drawLine(0, 25, 240, 25, TITLE_COLOR);
+  tft.drawLine(0, SCREEN_SEPARATOR_Y, SCREEN_WIDTH, SCREEN_SEPARATOR_Y, TITLE_COLOR);
   
   // Initial message
   tft.setTextSize(1);
   tft.setTextColor(TEXT_COLOR, BACKGROUND);
-  tft.setCursor(10, 40);
-  tft.println("Starting system...");
+  tft.setCursor(SCREEN_MARGIN, SCREEN_STARTING_Y);
+  tft.println(SCREEN_STARTING_TEXT);
+  
+  // Where the widgets go. The screen was just cleared, so none of them is
+  // showing anything and the next updateDisplay() draws them in full.
+  // Each reading's label widget is followed by its value widget
+  widgets[WIDGET_STATUS].place(SCREEN_MARGIN, SCREEN_STATUS_Y);
+  for (uint8_t i = 0; i < SCREEN_READINGS; i++) {
+    int16_t valueX = screenAfterLabel(screenReadingLabels[i]);
+    widgets[WIDGET_TEMP_LABEL + 2 * i].place(SCREEN_MARGIN, screenReadingY(i));
+    widgets[WIDGET_TEMP + 2 * i].place(valueX, screenReadingY(i));
+    valueFields[FIELD_TEMP + i].place(valueX, screenReadingY(i), SPRITE_FIELD_MAX_CHARS);
+  }
+  widgets[WIDGET_LED_LABEL].place(SCREEN_MARGIN, SCREEN_LED_Y);
+  widgets[WIDGET_LED].place(screenAfterLabel(SCREEN_LED_LABEL), SCREEN_LED_Y);
+  for (uint8_t i = 0; i < WIDGET_COUNT; i++) {
+    widgets[i].cleared();
+  }
+  for (uint8_t i = 0; i < FIELD_COUNT; i++) {
+    valueFields[i].cleared();
+  }
   
   Serial.println("Display initialized");
 }
 
 void setupBME280() {
-  tft.fillRect(0, 60, 240, 20, BACKGROUND);
-  tft.setCursor(10, 70);
+  tft.fillRect(0, SCREEN_SENSOR_BAND_Y, SCREEN_WIDTH, SCREEN_SENSOR_BAND_HEIGHT, BACKGROUND);
+  tft.setCursor(SCREEN_MARGIN, SCREEN_SENSOR_Y);
+  tft.setTextColor(TEXT_COLOR, BACKGROUND);
+  tft.print(SCREEN_SENSOR_STARTING);
+  
+  // Look for sensors at both addresses on both buses and start their init
+  // It doesn't block - serviceBME280() moves it along from here
+  // With the NVS cache a warm boot skips the calibration read entirely
+  bme280Bus.addBus(&i2cBus0);
+  bme280Bus.addBus(&i2cBus1);
+  bme280Bus.setCalibrationStore(&calibStore);
+  uint8_t found = bme280Bus.discover();
+  Serial.printf("BME280: %u device(s) answered on the I2C buses\n", found);
+}
+
+void serviceBME280() {
+  // Remember whether we already reported the result
+  static bool reported = false;
+  
+  // This also switches each sensor to forced mode once it's ready - we only
+  // read every couple of seconds, so there's no point in letting them convert
+  // continuously (less power and less self-heating)
+  bool done = bme280Bus.poll();
+  if (!done || reported) {
+    return;
+  }
+  reported = true;
+  
+  uint8_t ready = bme280Bus.getReadyCount();
+  finishDisplayWrites();
+  tft.fillRect(0, SCREEN_SENSOR_BAND_Y, SCREEN_WIDTH, SCREEN_SENSOR_BAND_HEIGHT, BACKGROUND);
+  tft.setCursor(SCREEN_MARGIN, SCREEN_SENSOR_Y);
   
-  // Initialize the BME280 sensor with our custom driver
-  if (bme280.begin()) {
-    Serial.println("BME280 sensor found and initialized!");
+  if (ready > 0) {
+    Serial.printf("%u BME280 sensor(s) found and initialized!\n", ready);
+    for (uint8_t i = 0; i < bme280Bus.getSensorCount(); i++) {
+      BME280_Driver &sensor = bme280Bus.getSensor(i);
+      if (!sensor.isReady()) {
+        continue;
+      }
+      Serial.printf("  bus %u addr 0x%02X: calibration %s, measurement time %lu us\n",
+                    bme280Bus.getReading(i).bus, sensor.getAddress(),
+                    sensor.usedCachedCalibration() ? "from cache" : "read from sensor",
+                    (unsigned long)sensor.getMeasurementTimeUs());
+    }
     tft.setTextColor(STATUS_COLOR, BACKGROUND);
-    tft.print("BME280: OK");
+    tft.print(SCREEN_SENSOR_OK);
+    tft.print(ready);
+    tft.print(ready == 1 ? SCREEN_SENSOR_ONE : SCREEN_SENSOR_MANY);
   } else {
     Serial.println("Could not find BME280 sensor!");
     tft.setTextColor(ERROR_COLOR, BACKGROUND);
-    tft.print("BME280: Not Found!");
+    tft.print(SCREEN_SENSOR_MISSING);
   }
-  delay(1000);
 }
 
 void readSensorData() {
-  // Read data from our custom BME280 driver
-  sensorData.temperature = bme280.readTemperature();
-  sensorData.humidity = bme280.readHumidity();
-  sensorData.pressure = bme280.readPressure();
+  // Trigger every sensor's conversion at once and read them all back
+  uint32_t transactionsBefore = bme280Bus.getTransactionCount();
+  uint8_t count = bme280Bus.sampleAll();
+  uint32_t transactionsUsed = bme280Bus.getTransactionCount() - transactionsBefore;
+  
+  // The first sensor is the one we show on the display
+  const BME280_Reading *primary = bme280Bus.getPrimaryReading();
+  if (!primary) {
+    primarySensor = -1;
+    return;  // Nothing ready yet
+  }
+  primarySensor = primary - &bme280Bus.getReading(0);
+  sensorData.temperature = primary->data.temperature;
+  sensorData.humidity = (int32_t)primary->data.humidity;
+  sensorData.pressure = (int32_t)primary->data.pressure;
   
   // Print to serial for debugging
-  Serial.printf("Temperature: %.2f°C, Humidity: %.2f%%, Pressure: %.2f hPa\n", 
-                sensorData.temperature, 
-                sensorData.humidity, 
-                sensorData.pressure);
+  char temp[16], humid[16], pres[16];
+  temp[formatCenti(temp, sensorData.temperature)] = '\0';
+  humid[formatCenti(humid, sensorData.humidity)] = '\0';
+  pres[formatCenti(pres, sensorData.pressure)] = '\0';
+  Serial.printf("Temperature: %s°C, Humidity: %s%%, Pressure: %s hPa (%u sensor(s), I2C transactions: %lu)\n", 
+                temp, humid, pres, count, (unsigned long)transactionsUsed);
+  
+  // Every sensor's reading goes to the network core, which aggregates them
+  // for the next publish. If it's been stuck long enough for the queue to
+  // fill up, the reading is dropped (and counted) - we never wait
+  uint32_t now = millis();
+  for (uint8_t i = 0; i < bme280Bus.getSensorCount(); i++) {
+    const BME280_Reading &reading = bme280Bus.getReading(i);
+    if (reading.valid) {
+      SensorSample sample;
+      sample.timestamp = now;
+      sample.sensor = i;
+      sample.bus = reading.bus;
+      sample.address = reading.address;
+      sample.primary = (i == primarySensor);
+      sample.data.temperature = reading.data.temperature;
+      sample.data.humidity = (int32_t)reading.data.humidity;
+      sample.data.pressure = (int32_t)reading.data.pressure;
+      sampleQueue.push(sample);
+    }
+  }
 }
 
-void updateDisplay() {
-  // Clear the data area
-  tft.fillRect(0, 90, 240, 110, BACKGROUND);
-  
-  // Show connection status
-  tft.setCursor(10, 95);
-  tft.setTextColor(mqttClient.connected() ? STATUS_COLOR : ERROR_COLOR, BACKGROUND);
-  tft.print("MQTT: ");
-  tft.println(mqttClient.connected() ? "Connected" : "Disconnected");
+void updateDisplay(uint8_t regions) {
+  // Only tell the widgets what they should show - the renderer works out
+  // which characters differ from what's on the screen and draws just those
+  // (no more wiping whole rows, so no flicker either)
+  if (regions & REGION_STATUS) {
+    bool online = mqttOnline.load();  // PubSubClient belongs to the other core
+    widgets[WIDGET_STATUS].set(online ? SCREEN_MQTT_CONNECTED : SCREEN_MQTT_DISCONNECTED,
+                               online ? STATUS_COLOR : ERROR_COLOR);
+  }
   
-  // Display sensor data
-  tft.setTextColor(TEXT_COLOR, BACKGROUND);
-  tft.setCursor(10, 115);
-  tft.print("Temperature: ");
-  tft.setTextColor(TITLE_COLOR, BACKGROUND);
-  tft.print(sensorData.temperature, 1);
-  tft.println(" C");
+  if (regions & REGION_READINGS) {
+    const int32_t values[SCREEN_READINGS] = {sensorData.temperature, sensorData.humidity, sensorData.pressure};
+    for (uint8_t i = 0; i < SCREEN_READINGS; i++) {
+      widgets[WIDGET_TEMP_LABEL + 2 * i].set(screenReadingLabels[i], TEXT_COLOR);
+      showValue(FIELD_TEMP + i, WIDGET_TEMP + 2 * i, values[i], screenReadingUnits[i]);
+    }
+  }
   
-  tft.setTextColor(TEXT_COLOR, BACKGROUND);
-  tft.setCursor(10, 135);
-  tft.print("Humidity: ");
-  tft.setTextColor(TITLE_COLOR, BACKGROUND);
-  tft.print(sensorData.humidity, 1);
-  tft.println(" %");
+  if (regions & REGION_LED) {
+    bool led = ledState.load();
+    widgets[WIDGET_LED_LABEL].set(SCREEN_LED_LABEL, TEXT_COLOR);
+    widgets[WIDGET_LED].set(led ? SCREEN_LED_ON : SCREEN_LED_OFF, led ? STATUS_COLOR : ERROR_COLOR);
+  }
   
-  tft.setTextColor(TEXT_COLOR, BACKGROUND);
-  tft.setCursor(10, 155);
-  tft.print("Pressure: ");
-  tft.setTextColor(TITLE_COLOR, BACKGROUND);
-  tft.print(sensorData.pressure, 1);
-  tft.println(" hPa");
+  // The widgets and the button are drawn by the CPU straight to the panel,
+  // so if they have anything to draw, the DMA transfer has to finish first
+  // (normally it did long ago). Usually they have nothing to draw
+  if ((regions & REGION_BUTTON) || displayRenderer.hasWork(widgets, WIDGET_COUNT)) {
+    finishDisplayWrites();
+  }
+  displayRenderer.render(widgets, WIDGET_COUNT);
   
-  // Display LED status
-  tft.setTextColor(TEXT_COLOR, BACKGROUND);
-  tft.setCursor(10, 175);
-  tft.print("LED Status: ");
-  tft.setTextColor(ledState ? STATUS_COLOR : ERROR_COLOR, BACKGROUND);
-  tft.println(ledState ? "ON" : "OFF");
+  if (regions & REGION_BUTTON) {
+    // Draw reset button
+    drawButton(SCREEN_BUTTON_X, SCREEN_BUTTON_Y, SCREEN_BUTTON_WIDTH, SCREEN_BUTTON_HEIGHT, SCREEN_BUTTON_LABEL);
+  }
   
-  // Draw reset button
-  drawButton(60, 200, 120, 30, "RESET");
+  pumpValueFields();  // Start sending the new values
+}
+
+// One reading, in cyan with one decimal place (plenty on screen). With DMA
+// it's drawn into its sprite right away - that's only RAM, so it's fine even
+// while the previous frame is still going out
+void showValue(uint8_t field, uint8_t widget, int32_t centi, const char* unit) {
+  char buffer[WIDGET_MAX_CHARS + 1];
+  TextBuffer text(buffer, sizeof(buffer));
+  text.addCenti(centi, 1).add(unit);
+#if DISPLAY_USE_DMA
+  uint32_t start = micros();
+  if (valueFields[field].render(buffer, TITLE_COLOR, BACKGROUND)) {
+    spriteStats.renders++;
+  }
+  spriteStats.renderUs += micros() - start;
+#else
+  widgets[widget].set(buffer, TITLE_COLOR);
+#endif
+}
+
+// Start sending the next value field that changed, if the panel isn't busy
+// with the previous one. TFT_eSPI runs one DMA transfer at a time and would
+// wait for the last one to finish, so instead loop() calls this on every
+// pass and we only ever start a transfer when the bus is free. We keep the
+// SPI bus until everything is sent (or finishDisplayWrites() needs it)
+void pumpValueFields() {
+#if DISPLAY_USE_DMA
+  if (displayDmaOpen && tft.dmaBusy()) {
+    return;
+  }
+  for (uint8_t i = 0; i < FIELD_COUNT; i++) {
+    if (!valueFields[i].isPending()) {
+      continue;
+    }
+    uint32_t start = micros();
+    if (!displayDmaOpen) {
+      tft.startWrite();
+      displayDmaOpen = true;
+    }
+    valueFields[i].push(tft);
+    spriteStats.pushes++;
+    spriteStats.bytes += valueFields[i].bytes();
+    spriteStats.pushUs += micros() - start;
+    return;
+  }
+  if (displayDmaOpen) {
+    tft.endWrite();  // All sent
+    displayDmaOpen = false;
+  }
+#endif
+}
+
+// Wait for the value fields' DMA transfer (if one is running) and give the
+// SPI bus back. Anything that draws with the CPU calls this first
+void finishDisplayWrites() {
+  if (displayDmaOpen) {
+    tft.dmaWait();
+    tft.endWrite();
+    displayDmaOpen = false;
+  }
+}
+
+void setupBacklog() {
+#if BACKLOG_SPILL_TO_FLASH
+  // Format on first use. Whatever was in the file is from before the reboot
+  // and its timestamps mean nothing now, so start empty
+  if (LittleFS.begin(true)) {
+    backlogSpill.clear();
+    backlog.setSpillStore(&backlogSpill);
+  } else {
+    Serial.println("LittleFS not available, backlog is RAM only");
+  }
+#endif
+}
+
+// Keep a sample for later instead of losing it (primary sensor only, that's
+// what the backlog is sized for)
+void bufferSample(const BufferedSample &sample) {
+  backlog.push(sample);
 }
 
 void publishSensorData() {
+  // Each sensor's window mean becomes one sample, which joins that sensor's
+  // batch, and a full batch goes out right away. While MQTT is down the
+  // primary sensor's samples go to the backlog instead. Samples that didn't
+  // change by more than the deadband (and aren't due for a heartbeat) are
+  // skipped altogether. A sensor with no new readings has nothing to send,
+  // so publishing faster than sampling doesn't repeat samples
+  collectSamples();
+  for (uint8_t i = 0; i < BME280_MAX_SENSORS; i++) {
+    SensorAggregate &window = aggregates[i];
+    if (window.count() == 0) {
+      continue;
+    }
+    
+    BufferedSample sample;
+    sample.timestamp = window.firstTime + (window.lastTime - window.firstTime) / 2;  // Middle of the window
+    sample.temperature = (int16_t)window.temperature.meanCenti();
+    sample.humidity = (uint16_t)window.humidity.meanCenti();
+    sample.pressure = (uint32_t)window.pressure.meanCenti();
+    
+    // With more than one reading per window, the full summary goes out too
+    if (window.count() > 1 && !publishAggregate(i)) {
+      summariesDropped++;
+    }
+    window.reset();
+    
+    if (!deadbands[i].shouldReport(sample)) {
+      continue;
+    }
+    if (!mqttClient.connected()) {
+      if (i == backlogSensor) {
+        bufferSample(sample);
+      } else {
+        batches[i].stats.dropped++;  // Only one sensor has a backlog
+      }
+      continue;
+    }
+    if (batches[i].add(sample)) {
+      publishBatch(i);
+    }
+  }
+}
+
+// {"bus":0,"addr":118,"t0":120000,"t1":129900,"n":100,
+//  "temperature":{"mean":23.45,"min":23.40,"max":23.51,"stddev":0.03},
+//  "humidity":{...},"pressure":{...}}
+// Returns false if it couldn't be sent (it's not kept for later)
+bool publishAggregate(uint8_t index) {
   if (!mqttClient.connected()) {
+    return false;
+  }
+  const SensorAggregate &window = aggregates[index];
+  const RunningStats* channels[3] = {&window.temperature, &window.humidity, &window.pressure};
+  const char* names[3] = {"temperature", "humidity", "pressure"};
+  
+  char buffer[PAYLOAD_MAX_BYTES];
+  TextBuffer json(buffer, sizeof(buffer));
+  json.add("{\"bus\":").addUInt(window.bus)
+      .add(",\"addr\":").addUInt(window.address)
+      .add(",\"t0\":").addUInt(window.firstTime)
+      .add(",\"t1\":").addUInt(window.lastTime)
+      .add(",\"n\":").addUInt(window.count());
+  for (uint8_t c = 0; c < 3; c++) {
+    json.add(",\"").add(names[c])
+        .add("\":{\"mean\":").addCenti(channels[c]->meanCenti())
+        .add(",\"min\":").addCenti(channels[c]->minimum())
+        .add(",\"max\":").addCenti(channels[c]->maximum())
+        .add(",\"stddev\":").addCenti(channels[c]->stddevCenti())
+        .add("}");
+  }
+  json.add("}");
+  
+  return !json.overflowed() && mqttClient.publish(mqtt_topic_aggregate, buffer);
+}
+
+void flushBatches() {
+  uint32_t now = millis();
+  for (uint8_t i = 0; i < bme280Bus.getSensorCount(); i++) {
+    if (batches[i].due(now)) {
+      publishBatch(i);
+    }
+  }
+}
+
+// Send one batch as a single message. If that doesn't work, the samples of the
+// primary sensor move to the backlog. The others are dropped - there's only
+// RAM for one backlog - and counted in "batch_dropped" in the status message
+bool publishBatch(uint8_t index) {
+  SampleBatcher &batch = batches[index];
+  const SensorAggregate &sensor = aggregates[index];  // Only for the bus and address
+  
+  // No float formatting in any of the encoders - the cycle count below
+  // shows what building the payload costs
+  uint32_t startCycles = ESP.getCycleCount();
+  
+  uint8_t buffer[PAYLOAD_MAX_BYTES];
+  size_t length = encodeBatch(MQTT_PAYLOAD_FORMAT, batch, sensor.bus, sensor.address,
+                              millis(), buffer, sizeof(buffer));
+  
+  uint32_t buildCycles = ESP.getCycleCount() - startCycles;
+  
+  if (length == 0 || !mqttClient.connected() || !mqttClient.publish(mqttDataTopic, buffer, length)) {
+    if (index == backlogSensor) {
+      for (uint8_t i = 0; i < batch.size(); i++) {
+        bufferSample(batch.sample(i));
+      }
+      batch.clear();
+    } else {
+      batch.drop();
+    }
+    return false;
+  }
+  uint8_t count = batch.size();
+  batch.sent(length, millis());
+  
+  // Size and latency numbers, to tune MQTT_BATCH_SAMPLES / MQTT_BATCH_AGE_MS
+  const BatchStats &stats = batch.stats;
+  Serial.printf("Published batch of %u to %s (%u bytes, built in %lu cycles)\n",
+                count, mqttDataTopic, (unsigned)length, (unsigned long)buildCycles);
+  if (MQTT_PAYLOAD_FORMAT == PAYLOAD_JSON) {
+    Serial.println((const char*)buffer);
+  }
+  Serial.printf("  so far: %lu msgs, %lu bytes/sample on the wire, latency avg %lu ms max %lu ms\n",
+                (unsigned long)stats.batches,
+                (unsigned long)(stats.wireBytes / stats.samples),
+                (unsigned long)(stats.latencySumMs / stats.samples),
+                (unsigned long)stats.maxLatencyMs);
+  
+  Serial.printf("  deadband: reported %lu of %lu samples (%lu heartbeats)\n",
+                (unsigned long)deadbands[index].reported, (unsigned long)deadbands[index].seen,
+                (unsigned long)deadbands[index].heartbeats);
+  return true;
+}
+
+void drainBacklog() {
+  if ((backlog.empty() && backlogBatch.size() == 0) || !mqttClient.connected()) {
     return;
   }
+  if (millis() - lastDrainTime < BACKLOG_DRAIN_INTERVAL_MS) {
+    return;  // Rate limit - one message per interval
+  }
+  lastDrainTime = millis();
+  
+  // Take the next batch out of the backlog (unless the last one didn't make
+  // it out - then we retry that one). Samples are only popped into the batch,
+  // so a failed publish never loses anything
+  if (backlogBatch.size() == 0) {
+    BufferedSample sample;
+    while (backlogBatch.size() < BACKLOG_DRAIN_BATCH && backlog.peek(sample)) {
+      backlogBatch.add(sample);
+      backlog.pop();
+    }
+  }
   
-  // Create JSON-formatted string with sensor data
-  char buffer[100];
-  snprintf(buffer, sizeof(buffer), 
-           "{\"temperature\":%.2f,\"humidity\":%.2f,\"pressure\":%.2f}",
-           sensorData.temperature, 
-           sensorData.humidity, 
-           sensorData.pressure);
+  // Same batch format as live data - "now" and "t0" tell the receiver how old it is
+  uint8_t buffer[PAYLOAD_MAX_BYTES];
+  const SensorAggregate &primary = aggregates[backlogSensor < 0 ? 0 : backlogSensor];
+  size_t length = encodeBatch(MQTT_PAYLOAD_FORMAT, backlogBatch, primary.bus, primary.address,
+                              millis(), buffer, sizeof(buffer));
+  if (length == 0 || !mqttClient.publish(mqttDataTopic, buffer, length)) {
+    return;  // Kept in backlogBatch, we'll try again next time
+  }
+  backlogBatch.sent(length, millis());
   
-  // Publish to MQTT topic
-  mqttClient.publish(mqtt_topic_publish, buffer);
-  Serial.printf("Published to %s: %s\n", mqtt_topic_publish, buffer);
+  if (backlog.empty()) {
+    Serial.printf("Backlog sent (%lu spilled to flash, %lu dropped)\n",
+                  (unsigned long)backlog.spilled, (unsigned long)backlog.dropped);
+  }
+}
+
+// Name, handler, and the screen regions to redraw when it worked
+constexpr CommandSpec commandList[] = {
+  {"RESET", handleResetCommand, REGION_SCREEN | REGION_ALL},
+  {"LED_ON", handleLedOnCommand, REGION_LED},
+  {"LED_OFF", handleLedOffCommand, REGION_LED},
+  {"SET_INTERVAL", handleIntervalCommand, 0},
+  {"SET_PERIOD", handlePeriodCommand, 0},
+  {"TASK_STATS", handleTaskStatsCommand, 0},
+  {"SET_DEADBAND", handleDeadbandCommand, 0},
+  {"SET_HEARTBEAT", handleHeartbeatCommand, 0},
+};
+static_assert(commandSlotsUnique(commandList, sizeof(commandList) / sizeof(commandList[0])),
+              "Two commands share a slot - change COMMAND_HASH_SHIFT in command_table.h");
+
+void setupCommands() {
+  for (const CommandSpec &spec : commandList) {
+    commands.add(spec);
+  }
 }
 
 void handleMQTTCallback(char* topic, byte* payload, unsigned int length) {
-  // Create a null-terminated string from the payload
-  char message[length + 1];
-  memcpy(message, payload, length);
-  message[length] = '\0';
-  
-  Serial.printf("Message received on topic [%s]: %s\n", topic, message);
-  
-  // Handle different commands
-  if (strcmp(message, "RESET") == 0) {
-    Serial.println("Resetting display");
-    displayCleared = true;
-    tft.fillScreen(BACKGROUND);
-    setupDisplay();
-    updateDisplay();
-  } 
-  else if (strcmp(message, "LED_ON") == 0) {
-    Serial.println("Turning LED ON");
-    digitalWrite(LED_PIN, HIGH);
-    ledState = true;
-  } 
-  else if (strcmp(message, "LED_OFF") == 0) {
-    Serial.println("Turning LED OFF");
-    digitalWrite(LED_PIN, LOW);
-    ledState = false;
-  }
-  
-  // Update the display to reflect any changes
-  updateDisplay();
+  // The table copies the payload into its own fixed buffer, finds the
+  // handler and tells us which parts of the screen to redraw
+  uint8_t regions = 0;
+  CommandResult result = commands.dispatch(payload, length, regions);
+  
+  if (result == COMMAND_TOO_LONG) {
+    Serial.printf("Ignoring %u-byte message on topic [%s] (max %d)\n", length, topic, COMMAND_MAX_LENGTH);
+    return;
+  }
+  Serial.printf("Message received on topic [%s]: %s\n", topic, commands.lastMessage());
+  if (result == COMMAND_UNKNOWN) {
+    Serial.println("Unknown command");
+  }
+  
+  // The display belongs to the sensor core - ask it to redraw
+  if (regions != 0) {
+    ControlMessage redraw = {CONTROL_REDRAW, 0, regions};
+    controlQueue.push(redraw);
+  }
+}
+
+bool handleResetCommand(const char* args) {
+  if (*args != '\0') {
+    return false;
+  }
+  Serial.println("Resetting display");
+  displayCleared = true;
+  return true;
 }
 
-void reconnectMQTT() {
-  // Try to connect to MQTT broker
-  if (WiFi.status() != WL_CONNECTED) {
-    return; // Can't connect to MQTT without WiFi
+bool handleLedOnCommand(const char* args) {
+  if (*args != '\0') {
+    return false;
   }
+  Serial.println("Turning LED ON");
+  digitalWrite(LED_PIN, HIGH);
+  ledState = true;
+  return true;
+}
+
+bool handleLedOffCommand(const char* args) {
+  if (*args != '\0') {
+    return false;
+  }
+  Serial.println("Turning LED OFF");
+  digitalWrite(LED_PIN, LOW);
+  ledState = false;
+  return true;
+}
+
+// Give the named task a new period, on whichever core owns it. False if the
+// task doesn't exist or the period is out of range
+bool applyPeriod(const char* name, uint32_t period) {
+  if (period < MIN_TASK_PERIOD_MS || period > MAX_TASK_PERIOD_MS) {
+    return false;
+  }
+  int8_t networkTaskIndex = networkScheduler.find(name);  // The names never change, so
+  int8_t sensorTaskIndex = sensorScheduler.find(name);    // reading them from here is fine
+  bool ok = false;
+  if (networkTaskIndex >= 0) {
+    ok = networkScheduler.setPeriod(networkTaskIndex, period);  // Our own core
+  } else if (sensorTaskIndex >= 0) {
+    ControlMessage change = {CONTROL_PERIOD, (uint8_t)sensorTaskIndex, period};
+    ok = controlQueue.push(change);  // The sensor core applies it
+  }
+  if (ok) {
+    Serial.printf("Task %s now runs every %lu ms\n", name, (unsigned long)period);
+  }
+  return ok;
+}
+
+// "SET_INTERVAL <ms>" - time between sensor readings, same as "SET_PERIOD sample <ms>"
+bool handleIntervalCommand(const char* args) {
+  uint32_t period = 0;
+  const char* end = parseUInt(args, period);
+  if (!end || *end != '\0' || !applyPeriod("sample", period)) {
+    Serial.printf("Usage: SET_INTERVAL <ms> (%d..%d)\n", MIN_TASK_PERIOD_MS, MAX_TASK_PERIOD_MS);
+    return false;
+  }
+  return true;
+}
+
+// "SET_PERIOD <task> <ms>" - task is sample, display, publish or keepalive
+bool handlePeriodCommand(const char* args) {
+  const char* space = strchr(args, ' ');
+  char name[16];
+  size_t nameLength = space ? (size_t)(space - args) : 0;
+  uint32_t period = 0;
+  const char* end = space ? parseUInt(space + 1, period) : nullptr;
+  bool ok = end && *end == '\0' && nameLength < sizeof(name);
+  if (ok) {
+    memcpy(name, args, nameLength);
+    name[nameLength] = '\0';
+    ok = applyPeriod(name, period);
+  }
+  if (!ok) {
+    Serial.printf("Usage: SET_PERIOD sample|display|publish|keepalive <ms> (%d..%d)\n",
+                  MIN_TASK_PERIOD_MS, MAX_TASK_PERIOD_MS);
+    return false;
+  }
+  return true;
+}
+
+// "TASK_STATS" - publish the scheduler's numbers, one message per task on
+// the status topic + "/tasks/<name>", then start counting again
+bool handleTaskStatsCommand(const char* args) {
+  if (*args != '\0') {
+    return false;
+  }
+  for (uint8_t i = 0; i < networkScheduler.size(); i++) {
+    publishTaskStats(networkScheduler.name(i), networkScheduler.periodMs(i), networkScheduler.stats(i));
+    networkScheduler.resetStats(i);
+  }
+  statsRequested.store(true);  // The sensor core's numbers follow from serviceConnection()
+  return true;
+}
+
+void publishTaskStats(const char* name, uint32_t periodMs, const TaskStats &stats) {
+  uint32_t runs = stats.runs ? stats.runs : 1;
+  char buffer[224];
+  TextBuffer json(buffer, sizeof(buffer));
+  json.add("{\"period_ms\":").addUInt(periodMs)
+      .add(",\"runs\":").addUInt(stats.runs)
+      .add(",\"overruns\":").addUInt(stats.overruns)
+      .add(",\"skipped\":").addUInt(stats.skipped)
+      .add(",\"jitter_avg_us\":").addUInt((uint32_t)(stats.totalJitterUs / runs))
+      .add(",\"jitter_max_us\":").addUInt(stats.maxJitterUs)
+      .add(",\"run_avg_us\":").addUInt((uint32_t)(stats.totalRunUs / runs))
+      .add(",\"run_max_us\":").addUInt(stats.maxRunUs)
+      .add("}");
   
-  Serial.print("Connecting to MQTT broker...");
+  char topic[64];
+  snprintf(topic, sizeof(topic), "%s/tasks/%s", mqtt_topic_status, name);
+  mqttClient.publish(topic, buffer);
+  Serial.printf("Task %s: %s\n", name, buffer);
+}
+
+// "SET_DEADBAND OFF", "SET_DEADBAND ON" or "SET_DEADBAND <°C> <%RH> <hPa>",
+// e.g. "SET_DEADBAND 0.2 1 0.15" - all sensors use the same thresholds
+bool handleDeadbandCommand(const char* args) {
+  DeadbandSettings settings = deadbands[0].getSettings();
   
-  if (mqttClient.connect(mqtt_client_id)) {
-    Serial.println("connected");
-    
-    // Subscribe to command topic
-    mqttClient.subscribe(mqtt_topic_subscribe);
-    Serial.printf("Subscribed to topic: %s\n", mqtt_topic_subscribe);
+  if (strcmp(args, "OFF") == 0) {
+    settings.enabled = false;
+  } else if (strcmp(args, "ON") == 0) {
+    settings.enabled = true;
   } else {
-    Serial.print("failed, rc=");
-    Serial.print(mqttClient.state());
-    Serial.println(" will try again later");
+    int32_t temperature, humidity, pressure;
+    const char* p = parseCenti(args, temperature);
+    p = p ? parseCenti(p + strspn(p, " "), humidity) : nullptr;
+    p = p ? parseCenti(p + strspn(p, " "), pressure) : nullptr;
+    if (!p || *p != '\0' || temperature < 0 || humidity < 0 || pressure < 0 ||
+        temperature > 0xFFFF || humidity > 0xFFFF) {
+      Serial.println("Usage: SET_DEADBAND OFF | ON | <degC> <%RH> <hPa>");
+      return false;
+    }
+    settings.enabled = true;
+    settings.temperature = (uint16_t)temperature;
+    settings.humidity = (uint16_t)humidity;
+    settings.pressure = (uint32_t)pressure;  // hundredths of hPa are Pa
+  }
+  
+  for (uint8_t i = 0; i < BME280_MAX_SENSORS; i++) {
+    deadbands[i].setSettings(settings);
+    deadbands[i].reset();  // Report the next sample against the new thresholds
+  }
+  
+  char t[16], h[16], pr[16];
+  t[formatCenti(t, settings.temperature)] = '\0';
+  h[formatCenti(h, settings.humidity)] = '\0';
+  pr[formatCenti(pr, (int32_t)settings.pressure)] = '\0';
+  Serial.printf("Deadband %s: %s C, %s %%, %s hPa, heartbeat %lu s\n",
+                settings.enabled ? "on" : "off", t, h, pr,
+                (unsigned long)(settings.heartbeatMs / 1000));
+  return true;
+}
+
+// "SET_HEARTBEAT <seconds>" - longest time between reports while the deadband is on
+bool handleHeartbeatCommand(const char* args) {
+  int32_t seconds;
+  const char* end = parseCenti(args, seconds);
+  if (!end || *end != '\0' || seconds < 100) {  // At least 1 s (value is in hundredths)
+    Serial.println("Usage: SET_HEARTBEAT <seconds>");
+    return false;
+  }
+  
+  for (uint8_t i = 0; i < BME280_MAX_SENSORS; i++) {
+    DeadbandSettings settings = deadbands[i].getSettings();
+    settings.heartbeatMs = (uint32_t)seconds * 10;
+    deadbands[i].setSettings(settings);
   }
+  Serial.printf("Heartbeat set to %ld s\n", (long)(seconds / 100));
+  return true;
+}
+
+void serviceMQTT() {
+  unsigned long now = millis();
+  
+  switch (mqttState) {
+    case MQTT_CONNECTED:
+      if (mqttClient.connected()) {
+        mqttClient.loop();  // Process any incoming MQTT messages
+        return;
+      }
+      // Lost it - don't retry right away, the broker may have just restarted
+      // and every other device noticed at the same moment
+      Serial.println("MQTT connection lost");
+      mqttBackoff.disconnected(now);
+      mqttState = MQTT_WAITING;
+      return;
+      
+    case MQTT_WAITING:
+      if (WiFi.status() != WL_CONNECTED || !mqttBackoff.due(now)) {
+        return;  // Can't connect to MQTT without WiFi, or it's not time yet
+      }
+      mqttState = MQTT_TCP_CONNECT;
+      return;
+      
+    case MQTT_TCP_CONNECT:
+      // Step 1: just the TCP connection, with a short timeout
+      Serial.printf("Connecting to MQTT broker (attempt %lu)...\n",
+                    (unsigned long)mqttBackoff.stats.attempts + 1);
+      mqttBackoff.attemptStarted();
+      mqttConnectStart = now;
+      if (!espClient.connect(mqtt_server, mqtt_port, MQTT_TCP_TIMEOUT_MS)) {
+        Serial.println("TCP connect failed");
+        break;
+      }
+      mqttState = MQTT_SESSION;  // Next pass through loop(), after sampling had its turn
+      return;
+      
+    case MQTT_SESSION:
+      // Step 2: PubSubClient sees the socket is already open and only does
+      // the MQTT handshake (bounded by MQTT_SOCKET_TIMEOUT_S)
+      if (!mqttClient.connect(mqtt_client_id)) {
+        Serial.printf("MQTT connect failed, rc=%d\n", mqttClient.state());
+        espClient.stop();
+        break;
+      }
+      mqttBackoff.succeeded(millis() - mqttConnectStart);
+      mqttState = MQTT_CONNECTED;
+      onMQTTConnected();
+      return;
+  }
+  
+  // The attempt failed: the window doubles and we pick a random wait in it
+  mqttBackoff.failed(millis(), millis() - mqttConnectStart);
+  mqttState = MQTT_WAITING;
+  Serial.printf("Will try again in %lu ms (window %lu ms)\n",
+                (unsigned long)mqttBackoff.stats.lastBackoffMs, (unsigned long)mqttBackoff.windowMs());
+}
+
+void onMQTTConnected() {
+  Serial.printf("MQTT connected in %lu ms\n", (unsigned long)mqttBackoff.stats.lastLatencyMs);
+  
+  // Subscribe to command topic
+  mqttClient.subscribe(mqtt_topic_subscribe);
+  Serial.printf("Subscribed to topic: %s\n", mqtt_topic_subscribe);
+  publishConnectionStats();
+  
+  // drainBacklog() takes it from here, starting one interval from now
+  if (!backlog.empty() || backlogBatch.size() > 0) {
+    Serial.printf("%lu samples waiting in the backlog\n", (unsigned long)backlog.size());
+    lastDrainTime = millis();
+  }
+}
+
+// The reconnect counters, so they can be watched from the broker side
+void publishConnectionStats() {
+  const ReconnectStats &stats = mqttBackoff.stats;
+  uint32_t batchDropped = 0;
+  for (uint8_t i = 0; i < BME280_MAX_SENSORS; i++) {
+    batchDropped += batches[i].stats.dropped;
+  }
+  
+  char buffer[320];
+  TextBuffer json(buffer, sizeof(buffer));
+  json.add("{\"attempts\":").addUInt(stats.attempts)
+      .add(",\"successes\":").addUInt(stats.successes)
+      .add(",\"failures\":").addUInt(stats.failures)
+      .add(",\"disconnects\":").addUInt(stats.disconnects)
+      .add(",\"last_connect_ms\":").addUInt(stats.lastLatencyMs)
+      .add(",\"max_connect_ms\":").addUInt(stats.maxLatencyMs)
+      .add(",\"avg_connect_ms\":").addUInt(stats.attempts ? stats.totalLatencyMs / stats.attempts : 0)
+      .add(",\"samples_dropped\":").addUInt(sampleQueue.dropped.load())  // Sensor -> network queue was full
+      .add(",\"batch_dropped\":").addUInt(batchDropped)  // Other sensors' samples while MQTT was down
+      .add(",\"summaries_dropped\":").addUInt(summariesDropped)  // Window summaries while MQTT was down
+      .add("}");
+  mqttClient.publish(mqtt_topic_status, buffer);
+  Serial.printf("Connection stats: %s\n", buffer);
 }
 
 void drawButton(int x, int y, int w, int h, String label) {
@@ -0,0 +1,347 @@
+#ifdef SIMULATION_MODE
+
+// Golden-image tests for the display
+//
+// display_simulation.txt and simulation_artifacts/display.ppm.txt were drawn
+// by hand, so nothing noticed when the screen came out wrong. Now each
+// scripted scenario (boot, WiFi failure, MQTT lost and back, LED toggle,
+// RESET) is drawn by the same screen code as the simulator, with fixed
+// readings so every run gives the same pixels, and compared pixel for pixel
+// with a reference PNG in simulation_artifacts/golden.
+//
+// It also catches the drawing getting slower. How many pixels and drawing
+// calls a scenario takes never changes from run to run, so going over the
+// recorded numbers fails the test. The render time is measured too (median
+// of a few runs) and flagged if it's way over the recorded one, but it
+// depends on the computer, so it doesn't fail the test.
+//
+// Usage: ./program --golden [check|update] [directory]
+// "update" draws every scenario and saves the results as the new goldens -
+// look at the PNGs before committing them!
+
+#include "simulation_helpers.h"
+#include "simulation_screen.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+namespace {
+
+// Fixed readings (hundredths: 23.50 C, 1013.25 hPa, 45.33 %RH and so on)
+const BME280_FixedData NO_READING = {0, 0, 0};   // What sensorData is before the first sample
+const BME280_FixedData READING_1 = {2350, 101325, 4533};
+const BME280_FixedData READING_2 = {2412, 101287, 4498};
+const BME280_FixedData READING_3 = {-125, 99870, 10000};
+
+// setup(): the display, the sensors starting, WiFi, then the first full
+// updateDisplay() (MQTT isn't up yet and there's no reading)
+void drawSetup(SimulatedScreen &screen, bool wifi) {
+    screen.drawScreen();
+    screen.showSensorStarting();
+    screen.showWiFiConnecting();
+    // setupWiFi() services the sensor init while it waits, so the sensors
+    // report during the first attempt; a failed connection goes through all
+    // 20, a good one here through 3
+    const int attempts = wifi ? 3 : 20;
+    for (int attempt = 0; attempt < attempts; attempt++) {
+        if (attempt == 0) {
+            screen.showSensorResult(1);
+        }
+        screen.showWiFiAttempt();
+    }
+    screen.showWiFiResult(wifi, "192.168.1.100");
+    screen.update(false, NO_READING, false);
+    screen.drawButton();
+}
+
+void scenarioBoot(SimulatedScreen &screen) {
+    drawSetup(screen, true);
+    screen.update(true, READING_1, false);   // Connected, first reading in
+}
+
+void scenarioWiFiFailure(SimulatedScreen &screen) {
+    drawSetup(screen, false);
+    screen.update(false, READING_1, false);  // Readings still show, MQTT never comes up
+}
+
+void scenarioMqttLost(SimulatedScreen &screen) {
+    scenarioBoot(screen);
+    screen.update(false, READING_2, false);
+}
+
+void scenarioMqttReconnect(SimulatedScreen &screen) {
+    scenarioMqttLost(screen);
+    screen.update(true, READING_3, false);
+}
+
+void scenarioLedToggle(SimulatedScreen &screen) {
+    scenarioBoot(screen);
+    screen.update(true, READING_1, true);    // LED_ON
+    screen.update(true, READING_1, false);   // LED_OFF
+    screen.update(true, READING_1, true);    // LED_ON
+}
+
+void scenarioReset(SimulatedScreen &screen) {
+    scenarioBoot(screen);
+    screen.update(true, READING_2, true);
+    screen.drawScreen();                     // RESET: clear and redraw everything
+    screen.update(true, READING_2, true);
+    screen.drawButton();
+}
+
+typedef struct {
+    const char *name;
+    void (*draw)(SimulatedScreen &screen);
+} GoldenScenario;
+
+const GoldenScenario scenarios[] = {
+    {"boot", scenarioBoot},
+    {"wifi_failure", scenarioWiFiFailure},
+    {"mqtt_lost", scenarioMqttLost},
+    {"mqtt_reconnect", scenarioMqttReconnect},
+    {"led_toggle", scenarioLedToggle},
+    {"reset", scenarioReset},
+};
+
+// What a scenario drew, and what it took
+typedef struct {
+    uint64_t hash;
+    uint32_t pixels;
+    uint32_t drawCalls;
+    double renderUs;
+} GoldenResult;
+
+const int TIMING_RUNS = 25;
+const double SLOW_FACTOR = 2.0;   // Render time flagged over this times the golden one...
+const double SLOW_SLACK_US = 20;  // ...plus this much, so timer noise on tiny numbers doesn't count
+
+// FNV-1a over the frame buffer, to see at a glance in golden.txt which frames changed
+uint64_t frameHash(const SimulatedDisplay &display) {
+    uint64_t hash = 14695981039346656037ull;
+    for (int i = 0; i < SimulatedDisplay::PIXELS; i++) {
+        hash = (hash ^ (display.frameBuffer[i] & 0xFF)) * 1099511628211ull;
+        hash = (hash ^ (display.frameBuffer[i] >> 8)) * 1099511628211ull;
+    }
+    return hash;
+}
+
+// Draw the scenario a few times on a fresh screen. The display keeps the
+// last run's pixels
+GoldenResult renderScenario(const GoldenScenario &scenario, SimulatedDisplay &display) {
+    std::vector<double> times;
+    for (int run = 0; run < TIMING_RUNS; run++) {
+        display.clearFrame(SCREEN_BACKGROUND);
+        display.pixelsWritten = 0;
+        display.drawCalls = 0;
+        SimulatedScreen screen(display);
+        auto start = std::chrono::steady_clock::now();
+        scenario.draw(screen);
+        times.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count());
+    }
+    std::sort(times.begin(), times.end());
+
+    GoldenResult result;
+    result.hash = frameHash(display);
+    result.pixels = display.pixelsWritten;
+    result.drawCalls = display.drawCalls;
+    result.renderUs = times[times.size() / 2];
+    return result;
+}
+
+void printResult(const char *name, const GoldenResult &result) {
+    char line[160];
+    snprintf(line, sizeof(line), "  %-15s %016llx  %7u pixels  %4u calls  %8.1f us\n", name,
+             (unsigned long long)result.hash, result.pixels, result.drawCalls, result.renderUs);
+    std::cout << line;
+}
+
+// golden.txt: one line per scenario - name, hash, pixels, draw calls, render time
+bool readManifest(const std::string &path, std::vector<std::pair<std::string, GoldenResult>> &entries) {
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        return false;
+    }
+    std::string line;
+    while (std::getline(file, line)) {
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        std::istringstream fields(line);
+        std::string name;
+        GoldenResult result;
+        fields >> name >> std::hex >> result.hash >> std::dec >> result.pixels >> result.drawCalls >> result.renderUs;
+        if (fields) {
+            entries.push_back(std::make_pair(name, result));
+        }
+    }
+    return true;
+}
+
+bool writeManifest(const std::string &path, const std::vector<std::pair<std::string, GoldenResult>> &entries) {
+    std::ofstream file(path);
+    if (!file.is_open()) {
+        return false;
+    }
+    file << "# Golden display scenarios, written by \"--golden update\"\n";
+    file << "# name  frame_hash  pixels_written  draw_calls  render_us (median, on the machine that wrote it)\n";
+    for (const auto &entry : entries) {
+        char line[160];
+        snprintf(line, sizeof(line), "%s %016llx %u %u %.1f\n", entry.first.c_str(),
+                 (unsigned long long)entry.second.hash, entry.second.pixels, entry.second.drawCalls,
+                 entry.second.renderUs);
+        file << line;
+    }
+    return true;
+}
+
+// A picture of what's different: the frame dimmed, changed pixels in magenta
+void saveDiff(const std::string &filename, const SimulatedDisplay &display, const std::vector<uint8_t> &golden) {
+    std::vector<uint16_t> diff(SimulatedDisplay::PIXELS);
+    for (int i = 0; i < SimulatedDisplay::PIXELS; i++) {
+        uint8_t rgb[3];
+        rgb565ToRgb888(display.frameBuffer[i], rgb);
+        if (memcmp(rgb, &golden[i * 3], 3) != 0) {
+            diff[i] = 0xF81F;
+        } else {
+            diff[i] = (uint16_t)((display.frameBuffer[i] >> 2) & 0x39E7);  // Each channel at a quarter
+        }
+    }
+    std::vector<uint8_t> png;
+    encodePng(diff.data(), SimulatedDisplay::WIDTH, SimulatedDisplay::HEIGHT, png);
+    writeFile(filename, png);
+}
+
+// Compare the frame with the golden PNG. Returns the number of pixels that
+// differ (-1 if there's no usable golden), and where they are
+int compareWithGolden(const SimulatedDisplay &display, const std::vector<uint8_t> &golden, int box[4]) {
+    int differ = 0;
+    box[0] = SimulatedDisplay::WIDTH;
+    box[1] = SimulatedDisplay::HEIGHT;
+    box[2] = -1;
+    box[3] = -1;
+    for (int i = 0; i < SimulatedDisplay::PIXELS; i++) {
+        uint8_t rgb[3];
+        rgb565ToRgb888(display.frameBuffer[i], rgb);
+        if (memcmp(rgb, &golden[i * 3], 3) != 0) {
+            int x = i % SimulatedDisplay::WIDTH, y = i / SimulatedDisplay::WIDTH;
+            box[0] = std::min(box[0], x);
+            box[1] = std::min(box[1], y);
+            box[2] = std::max(box[2], x);
+            box[3] = std::max(box[3], y);
+            differ++;
+        }
+    }
+    return differ;
+}
+
+int updateGoldens(const std::string &directory, SimulatedDisplay &display) {
+    std::error_code error;
+    std::filesystem::create_directories(directory, error);
+    std::vector<std::pair<std::string, GoldenResult>> entries;
+    for (const GoldenScenario &scenario : scenarios) {
+        GoldenResult result = renderScenario(scenario, display);
+        std::string path = directory + "/" + scenario.name + ".png";
+        std::vector<uint8_t> png;
+        encodePng(display.frameBuffer, SimulatedDisplay::WIDTH, SimulatedDisplay::HEIGHT, png);
+        if (!writeFile(path, png)) {
+            std::cerr << "Could not write " << path << std::endl;
+            return 1;
+        }
+        printResult(scenario.name, result);
+        entries.push_back(std::make_pair(std::string(scenario.name), result));
+    }
+    if (!writeManifest(directory + "/golden.txt", entries)) {
+        std::cerr << "Could not write " << directory << "/golden.txt" << std::endl;
+        return 1;
+    }
+    std::cout << "\nGoldens written to " << directory << " - check the PNGs before committing them\n";
+    return 0;
+}
+
+int checkGoldens(const std::string &directory, SimulatedDisplay &display) {
+    std::vector<std::pair<std::string, GoldenResult>> entries;
+    if (!readManifest(directory + "/golden.txt", entries)) {
+        std::cerr << "No " << directory << "/golden.txt - run with \"--golden update\" first" << std::endl;
+        return 1;
+    }
+
+    int failures = 0, slow = 0;
+    for (const GoldenScenario &scenario : scenarios) {
+        GoldenResult result = renderScenario(scenario, display);
+        printResult(scenario.name, result);
+
+        const GoldenResult *recorded = nullptr;
+        for (const auto &entry : entries) {
+            if (entry.first == scenario.name) {
+                recorded = &entry.second;
+            }
+        }
+        std::vector<uint8_t> png, golden;
+        int width = 0, height = 0;
+        if (!recorded || !readFile(directory + "/" + scenario.name + ".png", png) ||
+            !decodePng(png, width, height, golden) ||
+            width != SimulatedDisplay::WIDTH || height != SimulatedDisplay::HEIGHT) {
+            std::cout << "    [FAIL] no golden for this scenario\n";
+            failures++;
+            continue;
+        }
+
+        // The picture
+        int box[4];
+        int differ = compareWithGolden(display, golden, box);
+        if (differ > 0) {
+            std::string actual = std::string("golden_") + scenario.name + ".actual.png";
+            std::string diff = std::string("golden_") + scenario.name + ".diff.png";
+            std::vector<uint8_t> image;
+            encodePng(display.frameBuffer, SimulatedDisplay::WIDTH, SimulatedDisplay::HEIGHT, image);
+            writeFile(actual, image);
+            saveDiff(diff, display, golden);
+            char line[200];
+            snprintf(line, sizeof(line), "    [FAIL] %d pixels differ, in (%d,%d)-(%d,%d); see %s and %s\n",
+                     differ, box[0], box[1], box[2], box[3], actual.c_str(), diff.c_str());
+            std::cout << line;
+            failures++;
+        }
+
+        // The work: same pixels, same calls, or fewer
+        if (result.pixels > recorded->pixels || result.drawCalls > recorded->drawCalls) {
+            char line[160];
+            snprintf(line, sizeof(line), "    [FAIL] draws more than the golden (%u pixels, %u calls)\n",
+                     recorded->pixels, recorded->drawCalls);
+            std::cout << line;
+            failures++;
+        } else if (result.pixels < recorded->pixels || result.drawCalls < recorded->drawCalls) {
+            std::cout << "    less drawing than the golden - \"--golden update\" to keep it that way\n";
+        }
+
+        // The time, only a warning
+        if (result.renderUs > recorded->renderUs * SLOW_FACTOR + SLOW_SLACK_US) {
+            char line[120];
+            snprintf(line, sizeof(line), "    [SLOW] golden took %.1f us\n", recorded->renderUs);
+            std::cout << line;
+            slow++;
+        }
+    }
+
+    std::cout << "\n" << (failures == 0 ? "All golden scenarios match" : "Some golden scenarios FAILED");
+    if (slow > 0) {
+        std::cout << " (" << slow << " slower than recorded)";
+    }
+    std::cout << "\n";
+    return failures == 0 ? 0 : 1;
+}
+
+} // namespace
+
+int runGoldenTests(bool update, const std::string &directory) {
+    std::cout << "\n=== Golden display scenarios (" << directory << ") ===\n";
+    static SimulatedDisplay display;   // 115 KB, so not on the stack
+    return update ? updateGoldens(directory, display) : checkGoldens(directory, display);
+}
+
+#endif // SIMULATION_MODE
@@ -1,17 +1,68 @@
 #ifdef SIMULATION_MODE
 
 #include "simulation_helpers.h"
+#include "bme280_driver.h"
+#include "fixed_format.h"
+#include "batch_publisher.h"
+#include "payload_codec.h"
+#include "simulation_screen.h"
 #include <iostream>
 #include <thread>
 #include <chrono>
+#include <algorithm>
+#include <cstdlib>
 
 // Create our simulation objects - these replace the real hardware
 SimulatedDisplay simDisplay;  // Instead of the ST7789 LCD
 SimulatedBME280 simSensor;   // Instead of the real BME280 sensor
 SimulatedMQTT simMqtt;       // Instead of a real MQTT connection
 
+// The real driver, talking to the emulated chip over a simulated I2C bus
+BME280_EmulatedTransport simI2C;
+BME280_Driver simDriver(&simI2C, BME280_ADDRESS_PRIMARY);
+
+// Samples go out in batches like on the ESP32 (5 per message here, so the
+// short scenario still shows a couple of them)
+SampleBatcher simBatch(5, BATCH_DEFAULT_AGE_MS);
+
+// The screen, drawn like main.cpp does it (see simulation_screen.h)
+SimulatedScreen simScreen(simDisplay);
+
 // This runs instead of the Arduino setup() and loop() when in simulation mode
-int main() {
+// Run with "--bench" (optionally followed by a benchmark name) to run the
+// native benchmarks instead of the scenario, or "--golden [check|update]" for
+// the golden-image tests of the display
+// "--soak <cycles>" runs that many cycles without the 2 s waits, and
+// "--record <N>" saves every Nth frame to display_frames.seq (both optional)
+int main(int argc, char *argv[]) {
+    if (argc > 1 && std::string(argv[1]) == "--bench") {
+        return runBenchmarks(argc > 2 ? argv[2] : "all");
+    }
+    if (argc > 1 && std::string(argv[1]) == "--golden") {
+        bool update = argc > 2 && std::string(argv[2]) == "update";
+        return runGoldenTests(update, argc > 3 ? argv[3] : "simulation_artifacts/golden");
+    }
+    
+    int totalIterations = 10;
+    bool realTime = true;
+    uint32_t recordEvery = 0;
+    for (int a = 1; a + 1 < argc; a += 2) {
+        std::string option = argv[a];
+        if (option == "--soak") {
+            totalIterations = std::max(1, atoi(argv[a + 1]));
+            realTime = false;
+        } else if (option == "--record") {
+            recordEvery = (uint32_t)std::max(1, atoi(argv[a + 1]));
+            if (recordEvery > 0xFFFF) {
+                std::cerr << "--record: N can be at most 65535\n";
+                return 1;
+            }
+        }
+    }
+    if (recordEvery && !simDisplay.startRecording("display_frames.seq", recordEvery)) {
+        return 1;
+    }
+    
     // Welcome message
     std::cout << "=== BME280 Sensor Display MQTT Simulator ===\n";
     std::cout << "This shows how the system would work with real hardware\n";
@@ -31,18 +82,23 @@ int main() {
     simDisplay.logOperation("Fill screen with black background");
     simDisplay.logOperation("Draw title bar: BME280 Sensor");
     simDisplay.logOperation("Draw separator line below title");
+    simScreen.drawScreen();
     
     // Now connect to WiFi
     std::cout << "Trying to connect to WiFi network...\n";
     simDisplay.logOperation("Show 'Connecting to WiFi...' on screen");
+    simScreen.showWiFiConnecting();
     
     // Wait a bit - WiFi connection takes time in real life
-    std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+    if (realTime) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+    }
     
     // WiFi connected!
     std::cout << "WiFi connected successfully!\n";
     simDisplay.logOperation("Update to show 'WiFi: Connected'");
     simDisplay.logOperation("Display IP address: 192.168.1.100");
+    simScreen.showWiFiResult(true, "192.168.1.100");
     
     // Now connect to MQTT broker
     std::cout << "Connecting to MQTT broker at " << simMqtt.broker << "...\n";
@@ -52,22 +108,36 @@ int main() {
     std::cout << "Subscribing to command topic...\n";
     simMqtt.subscribe("sensor/bme280/commands");  // Same topic as real code
     
-    // Simulate BME280 sensor initialization
+    // BME280 sensor initialization - same driver code as on the ESP32
     std::cout << "Initializing BME280 sensor...\n";
-    simDisplay.logOperation("Display 'BME280: OK'");
+    simI2C.attach(&simSensor.chip);
+    if (simDriver.begin()) {
+        BME280_Settings settings = simDriver.getSettings();
+        settings.mode = BME280_MODE_FORCED;  // Sample on demand like the bus manager does
+        simDriver.setSettings(settings);
+        simDisplay.logOperation("Display 'BME280: OK'");
+        simScreen.showSensorResult(1);
+    } else {
+        std::cout << "BME280 init failed!\n";
+        simDisplay.logOperation("Display 'BME280: Failed'");
+        simScreen.showSensorResult(0);
+    }
     
     // Now let's run our main loop - just like the loop() function in Arduino
     // We'll run for 10 cycles (in real life this would run forever)
-    const int totalIterations = 10;
+    bool led = false;
     std::cout << "\nStarting main loop - will run for " << totalIterations << " cycles\n";
     
     for (int i = 0; i < totalIterations; i++) {
         std::cout << "\n----- Cycle " << (i + 1) << " of " << totalIterations << " -----\n";
         
-        // Read new data from our sensor
-        float temperature = simSensor.getTemperature();
-        float humidity = simSensor.getHumidity();
-        float pressure = simSensor.getPressure();
+        // Read new data from our sensor through the real driver
+        simSensor.updateEnvironment();
+        // (integers in hundredths, like the firmware - floats only for the log)
+        BME280_FixedData sample = simDriver.readForcedFixed();
+        float temperature = sample.temperature / 100.0f;
+        float humidity = sample.humidity / 100.0f;
+        float pressure = sample.pressure / 100.0f;
         
         // Save the readings to our log (for the assignment submission)
         simSensor.recordReading(temperature, humidity, pressure);
@@ -84,16 +154,31 @@ int main() {
         simDisplay.logOperation("Update temperature reading: " + std::to_string(temperature) + " °C");
         simDisplay.logOperation("Update humidity reading: " + std::to_string(humidity) + " %");
         simDisplay.logOperation("Update pressure reading: " + std::to_string(pressure) + " hPa");
-        simDisplay.logOperation("Show LED status: OFF");
+        simDisplay.logOperation(std::string("Show LED status: ") + (led ? "ON" : "OFF"));
+        simScreen.update(true, sample, led);
+        if (i == 0) {
+            simScreen.drawButton();
+        }
         
-        // Now publish our data to MQTT (as JSON, just like in the real code)
-        std::stringstream json;
-        json << "{\"temperature\":" << temperature 
-             << ",\"humidity\":" << humidity 
-             << ",\"pressure\":" << pressure << "}";
+        // Now add it to the batch and publish once it's full (as JSON, just
+        // like in the real code). The scenario's clock is 2 s per cycle
+        uint32_t now = (uint32_t)i * 2000;
+        BufferedSample buffered;
+        buffered.timestamp = now;
+        buffered.temperature = (int16_t)sample.temperature;
+        buffered.humidity = (uint16_t)sample.humidity;
+        buffered.pressure = sample.pressure;
         
-        std::cout << "Publishing to MQTT topic: sensor/bme280/data\n";
-        simMqtt.publish("sensor/bme280/data", json.str());  // Same as real code
+        if (simBatch.add(buffered)) {
+            char buffer[512];
+            TextBuffer json(buffer, sizeof(buffer));
+            simBatch.build(json, 0, BME280_ADDRESS_PRIMARY, now);
+            
+            std::string topic = std::string("sensor/bme280/data/") + payloadFormatName(PAYLOAD_JSON);
+            std::cout << "Publishing batch of " << (int)simBatch.size() << " to MQTT topic: " << topic << "\n";
+            simMqtt.publish(topic, json.c_str());  // Same as real code
+            simBatch.sent(json.len(), now);
+        }
         
         // Every third cycle, simulate receiving an MQTT command
         if (i % 3 == 2) {
@@ -101,10 +186,14 @@ int main() {
                 std::cout << "Simulating MQTT command: LED_ON\n";
                 simMqtt.simulateReceivedMessage("sensor/bme280/commands", "LED_ON");
                 simDisplay.logOperation("Update LED status: ON");
+                led = true;
+                simScreen.update(true, sample, led);
             } else {
                 std::cout << "Simulating MQTT command: LED_OFF\n";
                 simMqtt.simulateReceivedMessage("sensor/bme280/commands", "LED_OFF");
                 simDisplay.logOperation("Update LED status: OFF");
+                led = false;
+                simScreen.update(true, sample, led);
             }
         }
         
@@ -114,10 +203,18 @@ int main() {
             simMqtt.simulateReceivedMessage("sensor/bme280/commands", "RESET");
             simDisplay.logOperation("Reset display");
             simDisplay.logOperation("Redraw interface");
+            simScreen.drawScreen();
+            simScreen.update(true, sample, led);
+            simScreen.drawButton();
         }
         
+        // One frame per cycle for the recording (if there is one)
+        simDisplay.frameDone();
+        
         // Wait before next cycle
-        std::this_thread::sleep_for(std::chrono::milliseconds(2000));
+        if (realTime) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(2000));
+        }
     }
     
     // Save simulation logs and artifacts
@@ -125,6 +222,13 @@ int main() {
     
     // Save display frame as an image
     simDisplay.saveFrame("display_simulation.ppm");
+    simDisplay.savePng("display_simulation.png");
+    if (simDisplay.recorder.isOpen()) {
+        simDisplay.stopRecording();
+        std::cout << "Recorded " << simDisplay.recorder.framesRecorded << " frames (every "
+                  << recordEvery << "th) in " << simDisplay.recorder.bytesWritten
+                  << " bytes to display_frames.seq\n";
+    }
     
     // Save display operation log
     simDisplay.saveLog("display_operations.log");
@@ -136,7 +240,7 @@ int main() {
     simMqtt.saveLog("mqtt_communication.log");
     
     std::cout << "\nSimulation artifacts saved. Use these files for your assignment submission.\n";
-    std::cout << "1. display_simulation.ppm - A simulated screenshot of the display\n";
+    std::cout << "1. display_simulation.ppm/.png - A simulated screenshot of the display\n";
     std::cout << "2. display_operations.log - Log of all display operations\n";
     std::cout << "3. sensor_readings.csv - Record of all sensor readings\n";
     std::cout << "4. mqtt_communication.log - MQTT communication transcript\n\n";